@@ -25,12 +25,20 @@
 #include "ns3/wifi-module.h"
 #include "ns3/mobility-module.h"
 #include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/ipv4-static-routing-helper.h"
 #include "ns3/yans-wifi-channel.h"
 #include "ns3/interference-helper.h"
 #include "ns3/yans-wifi-phy.h"
 #include "ns3/error-rate-model.h"
 #include "ns3/yans-error-rate-model.h"
 #include "ns3/internet-module.h"
+#include "ns3/flow-monitor-module.h"
+#include "ns3/seq-ts-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/default-simulator-impl.h"
+#include "ns3/event-impl.h"
+#include "ns3/global-value.h"
+#include "../per_table.h"
 /*For Network Animator*/
 #include "ns3/netanim-module.h"
 #include<iostream>
@@ -38,29 +46,253 @@
 #include "ns3/propagation-loss-model.h"
 #include<algorithm>
 #include<vector>
+#include<map>
+#include<set>
+#include<typeinfo>
+#include<typeindex>
+#include<cxxabi.h>
 #include<math.h>
+#include<cstring>
 #include<ctime>
 #include<cstdlib>
 #include<iostream>
+#include<cstdio>
+#include<atomic>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<memory>
+#include<chrono>
+#include<sstream>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+#include<utime.h>
+#include<cerrno>
+#include<climits>
+#include<csignal>
 
 using namespace ns3;
 using namespace std;
 
 NS_LOG_COMPONENT_DEFINE ("cisc825-wifi-network-sinr");
 
+//-----------------------------------Random Number Streams---------------------------------------
+/*Kinds of entities owning random number streams
+ * */
+enum RngEntity {
+	RNG_TOPOLOGY = 0,	//id 0: AP positions, id 1: STA positions
+	RNG_STA = 1,		//counter-based: packet size, sub-stream 1 and up: mobility model
+	RNG_LINK = 2,		//id = STA * numAPs + AP, devices of the link simulation
+	RNG_SNAPSHOT = 3,	//Active STAs of an interference snapshot
+	RNG_BSS = 4,		//id = STA, or numSTAs + AP: one device of the BSS contention simulations
+	RNG_SHADOW = 5,		//id = STA, counter-based: log-normal shadowing towards every AP
+	RNG_FADING = 6,		//id = snapshot, counter-based: fading of every STA-AP pair
+	RNG_ENTITY_KINDS = 7
+};
+
+/*Central random number service
+ * Every entity draws from its own ns-3 stream derived from (seed, run, kind, id):
+ *     stream = kind << 48 | id << 6 | sub-stream
+ * so values do not depend on the order in which entities are processed, and
+ * parallel, sharded or resumed runs reproduce the serial results. One random
+ * variable object is kept per kind and rebound whenever a different entity
+ * draws; an entity therefore draws all its values in one go.
+ * Explicit streams must stay below 2^63, which ns-3 keeps for automatic assignment.
+ * */
+class RngService {
+public:
+	RngService();
+	int64_t GetStream(RngEntity kind, uint64_t id, uint32_t sub = 0);
+	//Stream number of an entity without recording it, safe from any thread
+	static int64_t StreamOf(RngEntity kind, uint64_t id, uint32_t sub = 0);
+	//Record entities firstId .. lastId drawn outside of GetStream
+	void NoteRange(RngEntity kind, uint64_t firstId, uint64_t lastId);
+	Ptr<UniformRandomVariable> Uniform(RngEntity kind, uint64_t id);
+	//Record the streams handed out, per kind, in a text file
+	void WriteAssignments(std::string fileName) const;
+private:
+	struct Slot {
+		Ptr<UniformRandomVariable> variable;
+		bool bound;
+		uint64_t id;
+		uint64_t minId;
+		uint64_t maxId;
+		uint64_t used;
+	};
+	Slot m_slots[RNG_ENTITY_KINDS];
+};
+
+RngService::RngService() {
+	for (int k = 0; k < RNG_ENTITY_KINDS; k++) {
+		m_slots[k].bound = false;
+		m_slots[k].id = 0;
+		m_slots[k].minId = 0;
+		m_slots[k].maxId = 0;
+		m_slots[k].used = 0;
+	}
+}
+
+int64_t RngService::GetStream(RngEntity kind, uint64_t id, uint32_t sub) {
+	Slot &slot = m_slots[kind];
+	slot.minId = slot.used == 0 ? id : std::min(slot.minId, id);
+	slot.maxId = slot.used == 0 ? id : std::max(slot.maxId, id);
+	slot.used++;
+	return StreamOf(kind, id, sub);
+}
+
+int64_t RngService::StreamOf(RngEntity kind, uint64_t id, uint32_t sub) {
+	return ((int64_t) kind << 48) | (int64_t) (id << 6) | (sub & 63);
+}
+
+void RngService::NoteRange(RngEntity kind, uint64_t firstId, uint64_t lastId) {
+	Slot &slot = m_slots[kind];
+	slot.minId = slot.used == 0 ? firstId : std::min(slot.minId, firstId);
+	slot.maxId = slot.used == 0 ? lastId : std::max(slot.maxId, lastId);
+	slot.used += lastId - firstId + 1;
+}
+
+Ptr<UniformRandomVariable> RngService::Uniform(RngEntity kind, uint64_t id) {
+	Slot &slot = m_slots[kind];
+	if (!slot.variable) {
+		slot.variable = CreateObject<UniformRandomVariable>();
+	}
+	if (!slot.bound || slot.id != id) {
+		//Restart at the beginning of the entity's own stream
+		slot.variable->SetStream(GetStream(kind, id));
+		slot.bound = true;
+		slot.id = id;
+	}
+	return slot.variable;
+}
+
+void RngService::WriteAssignments(std::string fileName) const {
+	static const char *names[RNG_ENTITY_KINDS] = {"topology", "sta", "link", "snapshot", "bss", "shadow", "fading"};
+	ofstream rs;
+	rs.open(fileName.c_str());
+	if (!rs.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store random stream assignments in file" << endl;
+		return;
+	}
+	rs << "seed " << RngSeedManager::GetSeed() << " run " << RngSeedManager::GetRun() << endl;
+	rs << "kind\tfirstId\tlastId\tfirstStream\tstride\trequests" << endl;
+	for (int k = 0; k < RNG_ENTITY_KINDS; k++) {
+		const Slot &slot = m_slots[k];
+		if (slot.used > 0) {
+			rs << names[k] << "\t" << slot.minId << "\t" << slot.maxId << "\t"
+					<< (((int64_t) k << 48) | (int64_t) (slot.minId << 6)) << "\t" << 64 << "\t" << slot.used << endl;
+		}
+	}
+	rs.close();
+}
+
+//Random number service shared by all stages of the program
+RngService g_rng;
+
+//-----------------------------------Counter-Based Random Numbers---------------------------------------
+/*Stateless random numbers for values drawn per (STA, AP) pair or per snapshot
+ * The n-th value of an entity is the SplitMix64 finalizer of key + n, where the key
+ * mixes (seed, run) with the entity's stream number from RngService::StreamOf. There
+ * is no state and no object per pair, so any thread can produce any slice of the
+ * values in batches and a run reproduces them whatever the order or the thread count.
+ * The (seed, run) part of the key is read once by SetRunKey on the main thread, before
+ * the parallel stages, since RngSeedManager goes through the global values unlocked.
+ * */
+class CounterRng {
+public:
+	CounterRng(RngEntity kind, uint64_t id, uint32_t sub = 0);
+	//Mix the current seed and run into the keys, call after the command line is parsed
+	static void SetRunKey();
+	uint64_t Bits(uint64_t counter) const;
+	//Uniform in (0, 1), never 0 so that its logarithm is finite
+	double Uniform(uint64_t counter) const;
+	//Standard normals for counters first .. first + count - 1, two per Box-Muller pair
+	void Normal(uint64_t first, uint32_t count, double *out) const;
+private:
+	static uint64_t Mix(uint64_t z);
+	static uint64_t s_runKey;
+	uint64_t m_key;
+};
+
+uint64_t CounterRng::s_runKey = 0;
+
+uint64_t CounterRng::Mix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void CounterRng::SetRunKey() {
+	s_runKey = Mix((uint64_t) RngSeedManager::GetSeed() * 0x9e3779b97f4a7c15ULL + RngSeedManager::GetRun());
+}
+
+CounterRng::CounterRng(RngEntity kind, uint64_t id, uint32_t sub) {
+	m_key = Mix(s_runKey ^ (uint64_t) RngService::StreamOf(kind, id, sub));
+}
+
+uint64_t CounterRng::Bits(uint64_t counter) const {
+	return Mix(m_key + counter * 0x9e3779b97f4a7c15ULL);
+}
+
+double CounterRng::Uniform(uint64_t counter) const {
+	return ((Bits(counter) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+void CounterRng::Normal(uint64_t first, uint32_t count, double *out) const {
+	//Pair p always uses counters 2p and 2p + 1, so a batch may start at any value
+	for (uint32_t n = 0; n < count; n++) {
+		uint64_t pair = (first + n) >> 1;
+		double radius = sqrt(-2.0 * log(Uniform(2 * pair)));
+		double angle = 2.0 * M_PI * Uniform(2 * pair + 1);
+		out[n] = ((first + n) & 1) ? radius * sin(angle) : radius * cos(angle);
+	}
+}
+
+/*Small-scale fading power gain |h|^2 with unit mean
+ * Rayleigh: exponential. Rician with K factor (linear): line of sight sqrt(K / (K + 1))
+ * plus scattered CN(0, 1 / (K + 1)). NO_FADING leaves the gain at 1.
+ * */
+enum FadingModel {
+	NO_FADING = 0,
+	RAYLEIGH_FADING = 1,
+	RICIAN_FADING = 2
+};
+
+double FadingGain(const CounterRng &rng, uint64_t counter, FadingModel model, double kFactor) {
+	switch (model) {
+	case RAYLEIGH_FADING:
+		return -log(rng.Uniform(counter));
+	case RICIAN_FADING: {
+		double h[2];
+		rng.Normal(2 * counter, 2, h);
+		double scatter = sqrt(0.5 / (kFactor + 1));
+		double re = sqrt(kFactor / (kFactor + 1)) + scatter * h[0];
+		double im = scatter * h[1];
+		return re * re + im * im;
+	}
+	default:
+		return 1.0;
+	}
+}
+
 /*Function to enable concurrent transmissions
  * and capture sources of interference for a typical STA_i
  * */
 //First Generate random number to determining active APs at time t
-int activeSTAs(int minU, int maxU){
-	Ptr<UniformRandomVariable> actv = CreateObject<UniformRandomVariable>();
+int activeSTAs(int minU, int maxU, uint32_t snapshot){
+	Ptr<UniformRandomVariable> actv = g_rng.Uniform(RNG_SNAPSHOT, snapshot);
 	return actv->GetInteger(minU, maxU);
 }
 
 //Second, Generate indexes of active STAs
-int actvSTAind(){
-	Ptr<UniformRandomVariable> actind = CreateObject<UniformRandomVariable>();
-	return actind->GetInteger(0, 299);
+int actvSTAind(uint32_t snapshot, int numUsers){
+	Ptr<UniformRandomVariable> actind = g_rng.Uniform(RNG_SNAPSHOT, snapshot);
+	return actind->GetInteger(0, numUsers - 1);
 }
 
 /*Function to calculate distance between Receiver AP and interfering node
@@ -72,178 +304,3625 @@ double disToRcverAP(Ptr<Node> apRx, Ptr<Node> staIntrf){
 	return dis2Rx;
 }
 
-/* Calculat the received SINR
- * */
-double sinrEstimate(double Irss, double signal_pwr, uint32_t channelW){
-	//Let us calculate noise
-	double Irss_lnr = pow(10, Irss/10); //Received power from interfering source
-	double sigPwr = pow(10, signal_pwr/10); //Signal power from desired node
-	static const double BOLTZMANN = 1.3803e-23; //Boltzmann Constant
-	//Receiver noise floor - thermal noise and non-idealities of receiver
-	double thermalNoise = BOLTZMANN * 290.0 * channelW*1000000;
-	double noiseFig = pow(10, .5);//Noise Figure linear
-	double noise = noiseFig * thermalNoise;
-	//Irss is the RSS between AP receiver and the interfering STAs
-	double sinr_linear = sigPwr / (noise + Irss_lnr);
-	//Finally SINR in db scale
-	double sinr_db = log10(sinr_linear);
-	//Return SINR
-	return sinr_db;
+//-----------------------------------SINR Kernel---------------------------------------
+/*Receiver noise floor in mW: thermal noise k T B plus a 5 dB noise figure,
+ * computed once per channel width (20, 40, 80 or 160 MHz)
+ * */
+double NoiseFloorMw(uint32_t channelW){
+	struct NoiseTable {
+		double mw[4];
+		NoiseTable() {
+			static const double BOLTZMANN = 1.3803e-23; //Boltzmann Constant
+			double noiseFig = pow(10, .5);//Noise Figure linear
+			for (int w = 0; w < 4; w++) {
+				mw[w] = noiseFig * BOLTZMANN * 290.0 * (20 << w) * 1000000 * 1000;
+			}
+		}
+	};
+	static const NoiseTable table;
+	switch (channelW) {
+	case 20: return table.mw[0];
+	case 40: return table.mw[1];
+	case 80: return table.mw[2];
+	case 160: return table.mw[3];
+	default: return table.mw[0] * channelW / 20.0;
+	}
+}
+
+/* Calculat the received SINR
+ * Irss and signal_pwr in dBm, returns the SINR in dB
+ * */
+double sinrEstimate(double Irss, double signal_pwr, uint32_t channelW){
+	double Irss_lnr = pow(10, Irss/10); //Received power from interfering source, mW
+	double sigPwr = pow(10, signal_pwr/10); //Signal power from desired node, mW
+	//Irss is the RSS between AP receiver and the interfering STAs
+	double sinr_linear = sigPwr / (NoiseFloorMw(channelW) + Irss_lnr);
+	//Finally SINR in db scale
+	return 10 * log10(sinr_linear);
+}
+
+/* Fast conversions between dBm and mW for the batched SINR kernel
+ * Branch-free and inlinable so the batch loops vectorize. Over the range of
+ * normal doubles:
+ *   FastDbmToMw: relative error below 1e-6 (4e-6 dB)
+ *   FastMwToDb:  absolute error below 2e-7 dB
+ * */
+//log2(10) / 10 and 10 / log2(10)
+static const double LOG2_10_OVER_10 = 0.33219280948873623;
+static const double DB_PER_OCTAVE = 3.0102999566398120;
+//1.5 * 2^52: adding it to a small integral double leaves the integer in the low mantissa bits,
+//which converts between double and int64 with integer adds only (no AVX-512 needed)
+static const double ROUND_MAGIC = 6755399441055744.0;
+static const int64_t ROUND_MAGIC_BITS = 0x4338000000000000LL;
+
+//2^y: 2^floor(y) is put in the exponent bits, 2^frac(y) from a degree 7 polynomial
+static inline double FastExp2(double y){
+	double n = std::floor(y);
+	double f = y - n;
+	double p = 1.0 + f * (0.6931471805599453 + f * (0.2402265069591007 + f * (0.05550410866482158
+			+ f * (0.009618129107628477 + f * (0.0013333558146428443 + f * (0.00015403530393381606
+			+ f * 1.525273380405984e-05))))));
+	double shifted = n + ROUND_MAGIC;
+	int64_t exponent;
+	std::memcpy(&exponent, &shifted, sizeof(exponent));
+	//Shifted unsigned, a negative exponent must not be left-shifted as a signed value
+	uint64_t bits;
+	std::memcpy(&bits, &p, sizeof(bits));
+	bits += (uint64_t) (exponent - ROUND_MAGIC_BITS) << 52;
+	std::memcpy(&p, &bits, sizeof(bits));
+	return p;
+}
+
+//log2(x) for x > 0: x = m 2^e with m in [sqrt(1/2), sqrt(2)), ln(m) = 2 atanh((m - 1) / (m + 1))
+static inline double FastLog2(double x){
+	static const int64_t SQRT_HALF_BITS = 0x3FE6A09E667F3BCDLL;
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	int64_t e = (int64_t) (bits - SQRT_HALF_BITS) >> 52;
+	bits -= (uint64_t) e << 52;
+	double m;
+	std::memcpy(&m, &bits, sizeof(bits));
+	double t = (m - 1) / (m + 1);
+	double t2 = t * t;
+	double ln = 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7))));
+	int64_t eBits = e + ROUND_MAGIC_BITS;
+	double exponent;
+	std::memcpy(&exponent, &eBits, sizeof(exponent));
+	return (exponent - ROUND_MAGIC) + ln * 1.4426950408889634;
+}
+
+static inline double FastDbmToMw(double dbm){
+	return FastExp2(dbm * LOG2_10_OVER_10);
+}
+
+static inline double FastMwToDb(double mw){
+	return FastLog2(mw) * DB_PER_OCTAVE;
+}
+
+/* Aggregate interference in mW of count interfering signals given in dBm
+ * */
+double InterferenceMw(const double *rssDbm, uint32_t count){
+	double sum = 0;
+	for (uint32_t n = 0; n < count; n++) {
+		sum += FastDbmToMw(rssDbm[n]);
+	}
+	return sum;
+}
+
+/* Batched SINR: sinrDb[n] = signalDbm[n] - 10 log10(noise + interferenceMw[n])
+ * */
+void SinrBatch(const double *signalDbm, const double *interferenceMw, uint32_t count, uint32_t channelW, double *sinrDb){
+	const double noise = NoiseFloorMw(channelW);
+	for (uint32_t n = 0; n < count; n++) {
+		sinrDb[n] = signalDbm[n] - FastMwToDb(noise + interferenceMw[n]);
+	}
+}
+
+/*Interfering RSS
+ * */
+double IRssVal(Ptr<Node>Aprx, Ptr<Node>IntrSTA){
+	Ptr<LogDistancePropagationLossModel> IrssmodelIntr = CreateObject<LogDistancePropagationLossModel>();
+	//Transmit Power of STAs
+	double txPower_STAdBm = +12; //12dBm, 15.85mW
+	//Get AP location on the network area
+	Ptr<MobilityModel> apfixMobility = Aprx->GetObject<MobilityModel>();
+	//Get STA location on the network area
+	Ptr<MobilityModel> staMobility = IntrSTA->GetObject<MobilityModel>();
+	//Compute the RSS for STA to AP Links
+	double IrxPowerDbm= IrssmodelIntr->CalcRxPower(txPower_STAdBm, staMobility,
+			apfixMobility);
+	return IrxPowerDbm;
+}
+
+/*Function to determine locations of APs and STAs
+ * And calculate distances between each AP and STA
+ * */
+//---------------------Distance between STAs and APs----------------------
+double disAPSTA(Ptr<Node> apNode, Ptr<Node> staNode) {
+	Ptr<MobilityModel> apfixMobility = apNode->GetObject<MobilityModel>();
+	Ptr<MobilityModel> staMobility = staNode->GetObject<MobilityModel>();
+	double disbtwAPnSTA = staMobility->GetDistanceFrom(apfixMobility);
+	//Return distance between AP and STA
+	return disbtwAPnSTA;
+}
+
+//Transmit Power of APs
+const double txPower_APdBm = +20.0; // 20dBm, 100mW
+//Transmit Power of STAs
+const double txPower_STAdBm = +12; //12dBm, 15.85mW
+
+//-----------------------------------Propagation Kernels---------------------------------------
+/* Parameter sets of the propagation kernels, fixed at compile time so that the
+ * kernels inline into the matrix loops and vectorize. Logarithms are taken with
+ * log() rather than log10() because vector math libraries provide the former.
+ * */
+//ns-3 LogDistancePropagationLossModel defaults, as used for the RSS matrices
+struct LogDistanceDefault {
+	static constexpr double exponent = 3.0;
+	static constexpr double referenceDistance = 1.0; //meters
+	static constexpr double referenceLoss = 46.6777; //dB
+};
+
+//Two-ray ground reflection with the AP mounted above the STAs
+struct TwoRay2_4GHz {
+	static constexpr double frequency = 2.4e9; //Hz
+	static constexpr double heightAp = 3.0; //meters
+	static constexpr double heightSta = 1.5; //meters
+	static constexpr double systemLoss = 1.0;
+	static constexpr double minDistance = 0.5; //meters
+};
+
+struct TwoRay5GHz {
+	static constexpr double frequency = 5.0e9; //Hz
+	static constexpr double heightAp = 3.0; //meters
+	static constexpr double heightSta = 1.5; //meters
+	static constexpr double systemLoss = 1.0;
+	static constexpr double minDistance = 0.5; //meters
+};
+
+//10 / ln(10), converts ln(x) into 10 log10(x)
+static constexpr double DB_PER_NEPER = 4.342944819032518;
+
+/* Log-distance path loss, identical to LogDistancePropagationLossModel::CalcRxPower
+ * */
+template <class P>
+struct LogDistanceKernel {
+	static const bool shadowing = false;
+	static inline double RxPower(double txPowerDbm, double distance, double /*shadowDb*/) {
+		const double d0 = P::referenceDistance;
+		double d = distance > d0 ? distance : d0;
+		return txPowerDbm - P::referenceLoss - P::exponent * DB_PER_NEPER * std::log(d / d0);
+	}
+};
+
+/* Log-distance path loss plus a per-link shadowing term in dB
+ * */
+template <class P>
+struct LogDistanceShadowingKernel {
+	static const bool shadowing = true;
+	static inline double RxPower(double txPowerDbm, double distance, double shadowDb) {
+		return LogDistanceKernel<P>::RxPower(txPowerDbm, distance, 0) + shadowDb;
+	}
+};
+
+/* Two-ray ground model: Friis up to the crossover distance 4 pi ht hr / lambda,
+ * d^-4 beyond it, as TwoRayGroundPropagationLossModel with unit antenna gains
+ * */
+template <class P>
+struct TwoRayKernel {
+	static const bool shadowing = false;
+	static inline double RxPower(double txPowerDbm, double distance, double /*shadowDb*/) {
+		const double lambda = 299792458.0 / P::frequency;
+		const double crossover = 4 * M_PI * P::heightAp * P::heightSta / lambda;
+		const double dMin = P::minDistance;
+		double d = distance > dMin ? distance : dMin;
+		double friis = DB_PER_NEPER * std::log(lambda * lambda / (16 * M_PI * M_PI * d * d * P::systemLoss));
+		double twoRay = DB_PER_NEPER * std::log(P::heightAp * P::heightAp * P::heightSta * P::heightSta
+				/ (d * d * d * d * P::systemLoss));
+		return txPowerDbm + (d <= crossover ? friis : twoRay);
+	}
+};
+
+/* Fill count RSS values from the matching distances (and shadowing, if used by the kernel)
+ * */
+template <class Kernel>
+void RssMatrix(const double *distance, const double *shadowDb, double txPowerDbm, double *rssDbm, uint64_t count) {
+	if (Kernel::shadowing) {
+		for (uint64_t n = 0; n < count; n++) {
+			rssDbm[n] = Kernel::RxPower(txPowerDbm, distance[n], shadowDb[n]);
+		}
+	} else {
+		for (uint64_t n = 0; n < count; n++) {
+			rssDbm[n] = Kernel::RxPower(txPowerDbm, distance[n], 0);
+		}
+	}
+}
+
+typedef void (*RssMatrixFn)(const double *distance, const double *shadowDb, double txPowerDbm, double *rssDbm, uint64_t count);
+
+/* Runtime selection of a kernel, done once per matrix build
+ * model: logdistance, logdistance-shadowing or tworay
+ * */
+RssMatrixFn SelectRssKernel(std::string model, double freqBand) {
+	if (model == "logdistance-shadowing") {
+		return &RssMatrix<LogDistanceShadowingKernel<LogDistanceDefault> >;
+	}
+	if (model == "tworay") {
+		return freqBand > 3 ? &RssMatrix<TwoRayKernel<TwoRay5GHz> > : &RssMatrix<TwoRayKernel<TwoRay2_4GHz> >;
+	}
+	if (model != "logdistance") {
+		cout << "Unknown propagation model " << model << ", using logdistance" << endl;
+	}
+	return &RssMatrix<LogDistanceKernel<LogDistanceDefault> >;
+}
+
+/*Generate Random packet sizes
+ * min packet size = 500 bytes and max packaet size = 1500
+ * */
+int payLoadSizeGenerator(int minPktSize, int maxPktSize, uint32_t sta){
+	//srand(time(0));
+	//return (rand() % (maxPktSize - minPktSize + 1) + minPktSize);
+	//A pure function of (seed, run, STA): the same size however often or in whatever order it is asked
+	double u = CounterRng(RNG_STA, sta).Uniform(0);
+	return minPktSize + std::min((int) (u * (maxPktSize - minPktSize + 1)), maxPktSize - minPktSize);
+}
+
+
+/*Fixed-size record of a per-packet trace event in the link simulations
+ * */
+struct PacketTraceRecord {
+	int64_t timeNs;		//Simulation time of the event
+	uint64_t uid;		//Packet uid
+	uint32_t link;		//STA index of the link being simulated
+	uint32_t nodeId;	//Node on which the event happened
+	uint32_t packetSize;
+	uint32_t event;		//PHY_RX_END, PHY_RX_DROP or UDP_RX
+};
+
+enum PacketTraceEvent {
+	PHY_RX_END = 0,
+	PHY_RX_DROP = 1,
+	UDP_RX = 2
+};
+
+/*Single-producer/single-consumer lock-free ring buffer of trace records
+ * The simulation thread pushes and never waits: a record that does not fit is
+ * counted as dropped. The writer thread pops in large batches. The slots are
+ * allocated by Reserve, before either thread uses the ring.
+ * */
+class PacketTraceRing {
+public:
+	PacketTraceRing();
+	void Reserve(uint32_t capacity);
+	bool Push(const PacketTraceRecord &record);
+	uint32_t Pop(PacketTraceRecord *out, uint32_t maxRecords);
+	uint64_t GetDropped() const;
+private:
+	std::vector<PacketTraceRecord> m_slots;
+	uint64_t m_mask;
+	//Head and tail on separate cache lines to avoid false sharing
+	alignas(64) std::atomic<uint64_t> m_head;	//Next slot written by the producer
+	alignas(64) std::atomic<uint64_t> m_tail;	//Next slot read by the consumer
+	alignas(64) std::atomic<uint64_t> m_dropped;
+};
+
+PacketTraceRing::PacketTraceRing() : m_mask(0), m_head(0), m_tail(0), m_dropped(0) {
+}
+
+void PacketTraceRing::Reserve(uint32_t capacity) {
+	//Round up to a power of two so that slots are found with a mask
+	uint64_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	m_slots.resize(size);
+	m_mask = size - 1;
+}
+
+bool PacketTraceRing::Push(const PacketTraceRecord &record) {
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) > m_mask) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	m_slots[head & m_mask] = record;
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+uint32_t PacketTraceRing::Pop(PacketTraceRecord *out, uint32_t maxRecords) {
+	uint64_t tail = m_tail.load(std::memory_order_relaxed);
+	uint64_t available = m_head.load(std::memory_order_acquire) - tail;
+	uint32_t n = (uint32_t) std::min<uint64_t>(available, maxRecords);
+	for (uint32_t r = 0; r < n; r++) {
+		out[r] = m_slots[(tail + r) & m_mask];
+	}
+	m_tail.store(tail + n, std::memory_order_release);
+	return n;
+}
+
+uint64_t PacketTraceRing::GetDropped() const {
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+/*Background thread draining the ring to a binary file in large writes
+ * File layout: char[4] "PKTR", uint32 version, uint32 record size, then the records
+ * */
+class PacketTraceWriter {
+public:
+	PacketTraceWriter(uint32_t capacity);
+	~PacketTraceWriter();
+	bool Start(std::string fileName);
+	void Stop();
+	PacketTraceRing &GetRing();
+	uint64_t GetWritten() const;
+private:
+	void Drain();
+	uint32_t m_capacity;
+	PacketTraceRing m_ring;
+	FILE *m_file;
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+	uint64_t m_written;
+};
+
+//The ring is only allocated by Start, a run without tracing does not pay for it
+PacketTraceWriter::PacketTraceWriter(uint32_t capacity) : m_capacity(capacity), m_file(0), m_running(false), m_written(0) {
+}
+
+//Early returns from main join the writer instead of destroying a running thread
+PacketTraceWriter::~PacketTraceWriter() {
+	Stop();
+}
+
+bool PacketTraceWriter::Start(std::string fileName) {
+	m_file = fopen(fileName.c_str(), "wb");
+	if (m_file == 0) {
+		return false;
+	}
+	uint32_t header[2] = {1, sizeof(PacketTraceRecord)};
+	fwrite("PKTR", 1, 4, m_file);
+	fwrite(header, sizeof(uint32_t), 2, m_file);
+	m_ring.Reserve(m_capacity);
+	m_running.store(true);
+	m_thread = std::thread(&PacketTraceWriter::Drain, this);
+	return true;
+}
+
+void PacketTraceWriter::Drain() {
+	std::vector<PacketTraceRecord> batch(1 << 16);
+	while (true) {
+		//Read the flag before popping so the last records are not missed
+		bool running = m_running.load();
+		uint32_t n = m_ring.Pop(&batch[0], batch.size());
+		if (n > 0) {
+			m_written += fwrite(&batch[0], sizeof(PacketTraceRecord), n, m_file);
+		} else if (!running) {
+			break;
+		} else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+void PacketTraceWriter::Stop() {
+	if (m_file == 0) {
+		return;
+	}
+	m_running.store(false);
+	m_thread.join();
+	fclose(m_file);
+	m_file = 0;
+}
+
+PacketTraceRing &PacketTraceWriter::GetRing() {
+	return m_ring;
+}
+
+uint64_t PacketTraceWriter::GetWritten() const {
+	return m_written;
+}
+
+//Per-packet trace writer, null when tracing is disabled
+PacketTraceWriter *g_packetTrace = 0;
+//Link (STA index) currently simulated, stamped on the trace records
+uint32_t g_traceLink = 0;
+
+void TracePacketEvent(Ptr<const Packet> p, PacketTraceEvent event) {
+	PacketTraceRecord record;
+	record.timeNs = Simulator::Now().GetNanoSeconds();
+	record.uid = p->GetUid();
+	record.link = g_traceLink;
+	record.nodeId = Simulator::GetContext();
+	record.packetSize = p->GetSize();
+	record.event = event;
+	g_packetTrace->GetRing().Push(record);
+}
+
+void PhyRxEndTrace(Ptr<const Packet> p) {
+	TracePacketEvent(p, PHY_RX_END);
+}
+
+void PhyRxDropTrace(Ptr<const Packet> p) {
+	TracePacketEvent(p, PHY_RX_DROP);
+}
+
+void LocalDeliverTrace(const Ipv4Header &header, Ptr<const Packet> p, uint32_t /*interface*/) {
+	if (header.GetProtocol() == UdpL4Protocol::PROT_NUMBER) {
+		TracePacketEvent(p, UDP_RX);
+	}
+}
+
+/*Hook the per-packet trace sinks on every node of the current simulation
+ * */
+void ConnectPacketTraces() {
+	Config::ConnectWithoutContext("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/PhyRxEnd", MakeCallback(&PhyRxEndTrace));
+	Config::ConnectWithoutContext("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/PhyRxDrop", MakeCallback(&PhyRxDropTrace));
+	Config::ConnectWithoutContext("/NodeList/*/$ns3::Ipv4L3Protocol/LocalDeliver", MakeCallback(&LocalDeliverTrace));
+}
+
+/*Streaming estimate of one quantile with the P-square algorithm
+ * (Jain and Chlamtac, 1985): five markers, constant memory and time per sample
+ * */
+class P2Quantile {
+public:
+	P2Quantile(double p);
+	void Add(double x);
+	double Get() const;
+private:
+	double m_p;
+	uint32_t m_count;
+	double m_q[5];		//Marker heights
+	double m_n[5];		//Marker positions
+	double m_np[5];		//Desired marker positions
+	double m_dn[5];		//Increments of the desired positions
+};
+
+P2Quantile::P2Quantile(double p) : m_p(p), m_count(0) {
+	double np[5] = {0, 2 * p, 4 * p, 2 + 2 * p, 4};
+	double dn[5] = {0, p / 2, p, (1 + p) / 2, 1};
+	for (int i = 0; i < 5; i++) {
+		m_q[i] = 0;
+		m_n[i] = i;
+		m_np[i] = np[i];
+		m_dn[i] = dn[i];
+	}
+}
+
+void P2Quantile::Add(double x) {
+	if (m_count < 5) {
+		m_q[m_count++] = x;
+		if (m_count == 5) {
+			std::sort(m_q, m_q + 5);
+		}
+		return;
+	}
+	//Cell k such that q[k] <= x < q[k+1], extending the extremes
+	int k;
+	if (x < m_q[0]) {
+		m_q[0] = x;
+		k = 0;
+	} else if (x >= m_q[4]) {
+		m_q[4] = x;
+		k = 3;
+	} else {
+		k = 0;
+		while (x >= m_q[k + 1]) {
+			k++;
+		}
+	}
+	for (int i = k + 1; i < 5; i++) {
+		m_n[i] += 1;
+	}
+	for (int i = 0; i < 5; i++) {
+		m_np[i] += m_dn[i];
+	}
+	//Adjust the three middle markers
+	for (int i = 1; i <= 3; i++) {
+		double d = m_np[i] - m_n[i];
+		if ((d >= 1 && m_n[i + 1] - m_n[i] > 1) || (d <= -1 && m_n[i - 1] - m_n[i] < -1)) {
+			int ds = d > 0 ? 1 : -1;
+			//Piecewise-parabolic prediction
+			double qp = m_q[i] + ds / (m_n[i + 1] - m_n[i - 1])
+					* ((m_n[i] - m_n[i - 1] + ds) * (m_q[i + 1] - m_q[i]) / (m_n[i + 1] - m_n[i])
+					+ (m_n[i + 1] - m_n[i] - ds) * (m_q[i] - m_q[i - 1]) / (m_n[i] - m_n[i - 1]));
+			if (m_q[i - 1] < qp && qp < m_q[i + 1]) {
+				m_q[i] = qp;
+			} else {
+				//Linear prediction
+				m_q[i] = m_q[i] + ds * (m_q[i + ds] - m_q[i]) / (m_n[i + ds] - m_n[i]);
+			}
+			m_n[i] += ds;
+		}
+	}
+	m_count++;
+}
+
+double P2Quantile::Get() const {
+	if (m_count == 0) {
+		return 0;
+	}
+	if (m_count < 5) {
+		//Exact nearest-rank quantile of the first samples
+		double q[5];
+		std::copy(m_q, m_q + m_count, q);
+		std::sort(q, q + m_count);
+		return q[(uint32_t) std::floor(m_p * (m_count - 1) + 0.5)];
+	}
+	return m_q[2];
+}
+
+/*Online per-BSS statistics of user throughput, updated as each link finishes
+ * Mean and variance use Welford's update; Jain's index is (sum x)^2 / (n sum x^2)
+ * */
+class BssAccumulator {
+public:
+	BssAccumulator();
+	void Add(double x);
+	uint32_t GetCount() const;
+	double GetSum() const;
+	double GetMean() const;
+	double GetVariance() const;
+	double GetMin() const;
+	double GetMax() const;
+	double GetJainIndex() const;
+	double GetP5() const;
+private:
+	uint32_t m_count;
+	double m_sum;
+	double m_sumSq;
+	double m_mean;
+	double m_m2;
+	double m_min;
+	double m_max;
+	P2Quantile m_p5;	//5th-percentile user throughput
+};
+
+BssAccumulator::BssAccumulator() : m_count(0), m_sum(0), m_sumSq(0), m_mean(0), m_m2(0), m_min(0), m_max(0), m_p5(0.05) {
+}
+
+void BssAccumulator::Add(double x) {
+	m_count++;
+	double delta = x - m_mean;
+	m_mean += delta / m_count;
+	m_m2 += delta * (x - m_mean);
+	m_sum += x;
+	m_sumSq += x * x;
+	m_min = (m_count == 1) ? x : std::min(m_min, x);
+	m_max = (m_count == 1) ? x : std::max(m_max, x);
+	m_p5.Add(x);
+}
+
+uint32_t BssAccumulator::GetCount() const {
+	return m_count;
+}
+
+double BssAccumulator::GetSum() const {
+	return m_sum;
+}
+
+double BssAccumulator::GetMean() const {
+	return m_mean;
+}
+
+double BssAccumulator::GetVariance() const {
+	return m_count > 1 ? m_m2 / (m_count - 1) : 0;
+}
+
+double BssAccumulator::GetMin() const {
+	return m_min;
+}
+
+double BssAccumulator::GetMax() const {
+	return m_max;
+}
+
+double BssAccumulator::GetJainIndex() const {
+	return m_sumSq > 0 ? m_sum * m_sum / (m_count * m_sumSq) : 0;
+}
+
+double BssAccumulator::GetP5() const {
+	return m_p5.Get();
+}
+
+/*Write one summary row per BSS followed by the whole network
+ * */
+void WriteBssSummary(const std::vector<BssAccumulator> &bssStats, const BssAccumulator &network, std::string fileName) {
+	ofstream bss;
+	bss.open(fileName.c_str());
+	if (!bss.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the BSS summary in file" << endl;
+		return;
+	}
+	bss << "AP\tUsers\tSum(Mbps)\tMean\tVariance\tMin\tMax\tJain\tP5" << endl;
+	for (uint32_t ap = 0; ap < bssStats.size(); ap++) {
+		const BssAccumulator &a = bssStats[ap];
+		bss << ap << "\t" << a.GetCount() << "\t" << a.GetSum() << "\t" << a.GetMean() << "\t" << a.GetVariance()
+				<< "\t" << a.GetMin() << "\t" << a.GetMax() << "\t" << a.GetJainIndex() << "\t" << a.GetP5() << endl;
+	}
+	bss << "all\t" << network.GetCount() << "\t" << network.GetSum() << "\t" << network.GetMean() << "\t" << network.GetVariance()
+			<< "\t" << network.GetMin() << "\t" << network.GetMax() << "\t" << network.GetJainIndex() << "\t" << network.GetP5() << endl;
+	bss.close();
+}
+
+//-----------------------------------Flow Statistics---------------------------------------
+/*Delay histogram with logarithmic buckets
+ * SUB_BUCKETS buckets per octave from 1 us up, so a quantile is within 4.4% of the
+ * true delay, and the memory of a flow stays constant whatever its packet count.
+ * */
+class LogHistogram {
+public:
+	LogHistogram();
+	void Add(double seconds);
+	uint64_t GetCount() const;
+	//Geometric centre of the bucket holding quantile q, 0 when empty
+	double GetQuantile(double q) const;
+private:
+	static const uint32_t SUB_BUCKETS = 8;
+	static const uint32_t OCTAVES = 28;	//1 us to about 4.5 min
+	static const uint32_t BUCKETS = SUB_BUCKETS * OCTAVES + 1;
+	uint64_t m_buckets[BUCKETS];
+	uint64_t m_count;
+};
+
+LogHistogram::LogHistogram() : m_count(0) {
+	std::fill(m_buckets, m_buckets + BUCKETS, 0);
+}
+
+void LogHistogram::Add(double seconds) {
+	double us = seconds * 1e6;
+	//Bucket 0 holds everything below 1 us
+	uint32_t b = us < 1 ? 0 : std::min<uint32_t>(BUCKETS - 1, 1 + (uint32_t) (log2(us) * SUB_BUCKETS));
+	m_buckets[b]++;
+	m_count++;
+}
+
+uint64_t LogHistogram::GetCount() const {
+	return m_count;
+}
+
+double LogHistogram::GetQuantile(double q) const {
+	if (m_count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t) ceil(q * m_count);
+	uint64_t seen = 0;
+	uint32_t b = 0;
+	for (; b < BUCKETS - 1; b++) {
+		seen += m_buckets[b];
+		if (seen >= rank && seen > 0) {
+			break;
+		}
+	}
+	return b == 0 ? 0.5e-6 : 1e-6 * pow(2.0, (b - 0.5) / SUB_BUCKETS);
+}
+
+/*Delay, jitter and loss of the flow of one link simulation
+ * */
+struct LinkStats {
+	uint32_t txPackets;
+	uint32_t rxPackets;
+	double lossRatio;
+	double meanDelay;	//s
+	double meanJitter;	//s, mean |delay difference| of consecutive packets
+	double p50;		//s
+	double p95;		//s
+	double p99;		//s
+	LogHistogram delays;
+};
+
+//Statistics of the last link simulation, collected while not null
+LinkStats *g_linkStats = 0;
+
+/*One-way delay of every UDP datagram delivered to the client port, from the
+ * SeqTsHeader time stamp the UdpClient puts in front of the payload
+ * */
+void DelayTrace(const Ipv4Header &header, Ptr<const Packet> p, uint32_t /*interface*/) {
+	if (g_linkStats == 0 || header.GetProtocol() != UdpL4Protocol::PROT_NUMBER) {
+		return;
+	}
+	Ptr<Packet> copy = p->Copy();
+	UdpHeader udp;
+	copy->RemoveHeader(udp);
+	if (udp.GetDestinationPort() != 9) {
+		return;
+	}
+	SeqTsHeader seqTs;
+	copy->PeekHeader(seqTs);
+	g_linkStats->delays.Add(Simulator::Now().GetSeconds() - seqTs.GetTs().GetSeconds());
+}
+
+//-----------------------------------Event Profiler---------------------------------------
+/*Wall time and invocations of one type of event
+ * */
+struct EventTypeStats {
+	uint64_t count;
+	double seconds;
+};
+
+/*Profile of the events run by every Simulator::Run of the process
+ * An event is identified by its C++ type. For events made by MakeEvent that is the
+ * class and signature of the handler (e.g. "void (ns3::UdpClient::*)()"), since the
+ * member function itself is only a runtime value.
+ * */
+class EventProfile {
+public:
+	void Record(const std::type_info &type, double seconds);
+	uint64_t GetEvents() const;
+	//Ranked by wall time, at most rows types
+	void WriteTable(std::ostream &os, uint32_t rows) const;
+	//One "Simulator::Run;owner;handler microseconds" line per type, for flamegraph.pl
+	bool WriteFolded(std::string fileName) const;
+private:
+	static std::string Label(std::type_index type);
+	//Class owning a member function handler, "function" otherwise
+	static std::string Owner(std::string label);
+	std::vector<std::pair<std::type_index, EventTypeStats> > Ranked() const;
+	std::map<std::type_index, EventTypeStats> m_types;
+};
+
+void EventProfile::Record(const std::type_info &type, double seconds) {
+	EventTypeStats &stats = m_types[std::type_index(type)];
+	stats.count++;
+	stats.seconds += seconds;
+}
+
+uint64_t EventProfile::GetEvents() const {
+	uint64_t events = 0;
+	for (std::map<std::type_index, EventTypeStats>::const_iterator it = m_types.begin(); it != m_types.end(); it++) {
+		events += it->second.count;
+	}
+	return events;
+}
+
+std::string EventProfile::Label(std::type_index type) {
+	int status = 0;
+	char *demangled = abi::__cxa_demangle(type.name(), 0, 0, &status);
+	std::string name = status == 0 ? demangled : type.name();
+	free(demangled);
+	//Keep the handler type, the first parameter of MakeEvent after its template arguments
+	size_t start = name.find("MakeEvent<");
+	if (start == std::string::npos) {
+		return name;
+	}
+	int depth = 0;
+	for (size_t c = start + strlen("MakeEvent"); c < name.size(); c++) {
+		if (name[c] == '<' || name[c] == '(') {
+			depth++;
+		} else if (name[c] == '>' || name[c] == ')') {
+			depth--;
+		}
+		if (depth == 0) {
+			start = c + 2;
+			break;
+		}
+	}
+	depth = 0;
+	for (size_t c = start; c < name.size(); c++) {
+		if (name[c] == '<' || name[c] == '(') {
+			depth++;
+		} else if (depth > 0 && (name[c] == '>' || name[c] == ')')) {
+			depth--;
+		} else if (depth == 0 && (name[c] == ',' || name[c] == ')')) {
+			return name.substr(start, c - start);
+		}
+	}
+	return name;
+}
+
+std::string EventProfile::Owner(std::string label) {
+	size_t end = label.find("::*)");
+	size_t start = label.rfind('(', end);
+	if (end == std::string::npos || start == std::string::npos) {
+		return "function";
+	}
+	return label.substr(start + 1, end - start - 1);
+}
+
+std::vector<std::pair<std::type_index, EventTypeStats> > EventProfile::Ranked() const {
+	std::vector<std::pair<std::type_index, EventTypeStats> > ranked(m_types.begin(), m_types.end());
+	std::sort(ranked.begin(), ranked.end(), [](const std::pair<std::type_index, EventTypeStats> &a,
+			const std::pair<std::type_index, EventTypeStats> &b) { return a.second.seconds > b.second.seconds; });
+	return ranked;
+}
+
+void EventProfile::WriteTable(std::ostream &os, uint32_t rows) const {
+	std::vector<std::pair<std::type_index, EventTypeStats> > ranked = Ranked();
+	double total = 0;
+	for (uint32_t r = 0; r < ranked.size(); r++) {
+		total += ranked[r].second.seconds;
+	}
+	os << "Rank\tSeconds\tShare(%)\tEvents\tns/event\tHandler" << endl;
+	for (uint32_t r = 0; r < ranked.size() && r < rows; r++) {
+		const EventTypeStats &stats = ranked[r].second;
+		os << r + 1 << "\t" << stats.seconds << "\t" << 100 * stats.seconds / total << "\t" << stats.count << "\t"
+				<< 1e9 * stats.seconds / stats.count << "\t" << Label(ranked[r].first) << endl;
+	}
+}
+
+bool EventProfile::WriteFolded(std::string fileName) const {
+	ofstream fs;
+	fs.open(fileName.c_str());
+	if (!fs.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the folded event stacks in file" << endl;
+		return false;
+	}
+	std::vector<std::pair<std::type_index, EventTypeStats> > ranked = Ranked();
+	for (uint32_t r = 0; r < ranked.size(); r++) {
+		std::string label = Label(ranked[r].first);
+		fs << "Simulator::Run;" << Owner(label) << ";" << label << " " << (uint64_t) (1e6 * ranked[r].second.seconds) << endl;
+	}
+	fs.close();
+	return true;
+}
+
+//Profile of all link simulations, filled when --profileEvents selects the profiling scheduler
+EventProfile g_eventProfile;
+
+/* Default simulator that times every event it runs
+ * Each scheduled event is wrapped in a ProfiledEvent that invokes it between two clock
+ * reads and records the time under the type of the wrapped event. The wrapper owns the
+ * reference handed to the scheduler, and cancelling goes through the wrapper, so
+ * EventId semantics are unchanged. Selected through SimulatorImplementationType.
+ * */
+class ProfilingSimulatorImpl : public DefaultSimulatorImpl {
+public:
+	static TypeId GetTypeId (void);
+	virtual EventId Schedule (Time const &delay, EventImpl *event);
+	virtual void ScheduleWithContext (uint32_t context, Time const &delay, EventImpl *event);
+	virtual EventId ScheduleNow (EventImpl *event);
+	virtual EventId ScheduleDestroy (EventImpl *event);
+private:
+	class ProfiledEvent : public EventImpl {
+	public:
+		ProfiledEvent (EventImpl *event) : m_event (event) {}
+		virtual ~ProfiledEvent () { m_event->Unref (); }
+	protected:
+		virtual void Notify (void) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+			m_event->Invoke ();
+			g_eventProfile.Record (typeid (*m_event),
+					std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ());
+		}
+	private:
+		EventImpl *m_event;
+	};
+};
+
+NS_OBJECT_ENSURE_REGISTERED (ProfilingSimulatorImpl);
+
+TypeId ProfilingSimulatorImpl::GetTypeId (void) {
+	static TypeId tid = TypeId ("ns3::ProfilingSimulatorImpl")
+		.SetParent<DefaultSimulatorImpl> ()
+		.SetGroupName ("Core")
+		.AddConstructor<ProfilingSimulatorImpl> ();
+	return tid;
+}
+
+EventId ProfilingSimulatorImpl::Schedule (Time const &delay, EventImpl *event) {
+	return DefaultSimulatorImpl::Schedule (delay, new ProfiledEvent (event));
+}
+
+void ProfilingSimulatorImpl::ScheduleWithContext (uint32_t context, Time const &delay, EventImpl *event) {
+	DefaultSimulatorImpl::ScheduleWithContext (context, delay, new ProfiledEvent (event));
+}
+
+EventId ProfilingSimulatorImpl::ScheduleNow (EventImpl *event) {
+	return DefaultSimulatorImpl::ScheduleNow (new ProfiledEvent (event));
+}
+
+EventId ProfilingSimulatorImpl::ScheduleDestroy (EventImpl *event) {
+	return DefaultSimulatorImpl::ScheduleDestroy (new ProfiledEvent (event));
+}
+
+//-----------------------------------Memory Accounting---------------------------------------
+/*Current resident set size of the process in bytes
+ * */
+uint64_t CurrentRssBytes(){
+	unsigned long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm != 0) {
+		if (fscanf(statm, "%lu %lu", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(statm);
+	}
+	return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+/*Peak resident set size of the process in bytes
+ * */
+uint64_t PeakRssBytes(){
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t) usage.ru_maxrss * 1024;
+}
+
+/*Live ns-3 objects by TypeId and memory growth across link simulations
+ * CountObjects walks the NodeList and ChannelList: every object aggregated to a node,
+ * its devices with the PHY, MAC and rate manager of Wi-Fi devices, its applications
+ * and the channels. Simulator::Destroy empties both lists, so before it TrackLink
+ * keeps a Ptr to every node, device, PHY, MAC and application of the link; once the
+ * link has returned and dropped its own references, CheckSurvivors counts by TypeId
+ * the tracked objects still referenced elsewhere. LinkDone samples the RSS after
+ * every link; an object surviving its link, or an RSS that keeps growing over the
+ * second half of the links, flags a leak.
+ * */
+class MemoryAccounting {
+public:
+	MemoryAccounting();
+	void CountObjects(std::string label);
+	//Count the objects of the first link only, the later ones are alike
+	bool WantsLinkCount() const;
+	//Hold the objects of a link across Simulator::Destroy
+	void TrackLink(NodeContainer nodes);
+	//Count the tracked objects still referenced, call once the link has returned
+	void CheckSurvivors();
+	void LinkDone();
+	bool IsLeaking() const;
+	void Write(std::string fileName, const class BenchmarkReport &report) const;
+private:
+	//Least squares RSS growth per link over the second half of the links
+	double GetGrowthPerLink() const;
+	typedef std::map<std::string, uint32_t> Counts;
+	std::vector<std::pair<std::string, Counts> > m_counts;
+	std::vector<uint64_t> m_linkRss;
+	std::vector<Ptr<Object> > m_tracked;
+	Counts m_survivors;
+	bool m_linkCounted;
+};
+
+//Sustained RSS growth per link above which the links are considered leaking
+static const double LEAK_BYTES_PER_LINK = 4096;
+//Links needed before the growth is judged
+static const uint32_t LEAK_MIN_LINKS = 10;
+
+MemoryAccounting::MemoryAccounting() : m_linkCounted(false) {
+}
+
+void MemoryAccounting::CountObjects(std::string label) {
+	Counts counts;
+	for (uint32_t n = 0; n < NodeList::GetNNodes(); n++) {
+		Ptr<Node> node = NodeList::GetNode(n);
+		Object::AggregateIterator aggregates = node->GetAggregateIterator();
+		while (aggregates.HasNext()) {
+			counts[aggregates.Next()->GetInstanceTypeId().GetName()]++;
+		}
+		for (uint32_t d = 0; d < node->GetNDevices(); d++) {
+			Ptr<NetDevice> device = node->GetDevice(d);
+			counts[device->GetInstanceTypeId().GetName()]++;
+			Ptr<WifiNetDevice> wifiDevice = DynamicCast<WifiNetDevice>(device);
+			if (wifiDevice) {
+				counts[wifiDevice->GetPhy()->GetInstanceTypeId().GetName()]++;
+				counts[wifiDevice->GetMac()->GetInstanceTypeId().GetName()]++;
+				counts[wifiDevice->GetRemoteStationManager()->GetInstanceTypeId().GetName()]++;
+			}
+		}
+		for (uint32_t a = 0; a < node->GetNApplications(); a++) {
+			counts[node->GetApplication(a)->GetInstanceTypeId().GetName()]++;
+		}
+	}
+	for (uint32_t c = 0; c < ChannelList::GetNChannels(); c++) {
+		counts[ChannelList::GetChannel(c)->GetInstanceTypeId().GetName()]++;
+	}
+	m_counts.push_back(std::make_pair(label, counts));
+}
+
+bool MemoryAccounting::WantsLinkCount() const {
+	return !m_linkCounted;
+}
+
+void MemoryAccounting::TrackLink(NodeContainer nodes) {
+	//The previous link has returned by now
+	CheckSurvivors();
+	for (uint32_t n = 0; n < nodes.GetN(); n++) {
+		Ptr<Node> node = nodes.Get(n);
+		m_tracked.push_back(node);
+		for (uint32_t d = 0; d < node->GetNDevices(); d++) {
+			Ptr<NetDevice> device = node->GetDevice(d);
+			m_tracked.push_back(device);
+			Ptr<WifiNetDevice> wifiDevice = DynamicCast<WifiNetDevice>(device);
+			if (wifiDevice) {
+				m_tracked.push_back(wifiDevice->GetPhy());
+				m_tracked.push_back(wifiDevice->GetMac());
+			}
+		}
+		for (uint32_t a = 0; a < node->GetNApplications(); a++) {
+			m_tracked.push_back(node->GetApplication(a));
+		}
+	}
+}
+
+void MemoryAccounting::CheckSurvivors() {
+	for (uint32_t t = 0; t < m_tracked.size(); t++) {
+		//One reference is the tracking Ptr itself
+		if (m_tracked[t]->GetReferenceCount() > 1) {
+			m_survivors[m_tracked[t]->GetInstanceTypeId().GetName()]++;
+		}
+	}
+	m_tracked.clear();
+}
+
+void MemoryAccounting::LinkDone() {
+	m_linkCounted = true;
+	m_linkRss.push_back(CurrentRssBytes());
+}
+
+double MemoryAccounting::GetGrowthPerLink() const {
+	uint32_t first = m_linkRss.size() / 2;
+	uint32_t n = m_linkRss.size() - first;
+	if (n < 2) {
+		return 0;
+	}
+	double meanX = 0, meanY = 0;
+	for (uint32_t l = first; l < m_linkRss.size(); l++) {
+		meanX += (double) l / n;
+		meanY += (double) m_linkRss[l] / n;
+	}
+	double sxy = 0, sxx = 0;
+	for (uint32_t l = first; l < m_linkRss.size(); l++) {
+		sxy += (l - meanX) * (m_linkRss[l] - meanY);
+		sxx += (l - meanX) * (l - meanX);
+	}
+	return sxy / sxx;
+}
+
+bool MemoryAccounting::IsLeaking() const {
+	return !m_survivors.empty()
+			|| (m_linkRss.size() >= LEAK_MIN_LINKS && GetGrowthPerLink() > LEAK_BYTES_PER_LINK);
+}
+
+//Memory accounting shared by the link simulations and main
+MemoryAccounting g_memory;
+
+/* Pre-populate the ARP cache of every IPv4 interface on a link with
+ * permanent entries for its peers, so the first datagram is not held
+ * back waiting for an ARP request/reply exchange
+ * */
+void PopulateArpCache(NetDeviceContainer devices, Ipv4InterfaceContainer interfaces){
+	for (uint32_t a = 0; a < devices.GetN(); a++) {
+		Ptr<Ipv4L3Protocol> ipv4 = devices.Get(a)->GetNode()->GetObject<Ipv4L3Protocol>();
+		int32_t ifIndex = ipv4->GetInterfaceForDevice(devices.Get(a));
+		Ptr<ArpCache> arp = ipv4->GetInterface(ifIndex)->GetArpCache();
+		for (uint32_t b = 0; b < devices.GetN(); b++) {
+			if (a == b) {
+				continue;
+			}
+			ArpCache::Entry *entry = arp->Add(interfaces.GetAddress(b));
+			//ns-3.26 spells the setter with three s
+			entry->SetMacAddresss(devices.Get(b)->GetAddress());
+			entry->MarkPermanent();
+		}
+	}
+}
+
+/* Simulate one AP to STA link and return the UDP throughput in Mbit/s
+ * mcs is the HT MCS index, chWidth in MHz and sgi enables the short guard interval.
+ *
+ * In the default mode the STA discovers and associates with the AP through beacons
+ * (StaWifiMac with ActiveProbing false), resolves ARP and relies on global routing,
+ * which costs the first second of every run before the client starts.
+ * With fastStart the pair is pre-associated as a static BSS: both ends run a MAC
+ * without beaconing or association, ARP caches are seeded with permanent entries
+ * and the on-link routes come from static routing, so the client starts at t = 0
+ * and the setup cost is linear in the number of nodes.
+ * The random streams of the link devices start at stream, those of the stack at stream + 32.
+ * While g_linkStats is set the flow is watched by a FlowMonitor for loss, mean delay
+ * and jitter, and the delay of every datagram goes into its log histogram.
+ * */
+double LinkThroughput(double distance, int payLoadSize, int mcs, uint32_t chWidth, bool sgi,
+		double simulationTime, bool fastStart, int64_t stream){
+	//Time before the client starts sending
+	double warmUp = fastStart ? 0.0 : 1.0;
+	NodeContainer staNode; //Inner Node Container
+	staNode.Create (1);
+	//AP Node container
+	NodeContainer apNodes;
+	apNodes.Create (1);
+	//Wifi Helper
+	YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+	YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+	phy.SetChannel (channel.Create ());
+	// Set guard interval
+	phy.Set ("ShortGuardEnabled", BooleanValue (sgi));
+	//Call Wifi Mac Class
+	WifiMacHelper mac;
+	WifiHelper wifi;
+	//Set Wifi Stanard 802.11n on 2.4GHz ISM band
+	wifi.SetStandard (WIFI_PHY_STANDARD_80211n_2_4GHZ);
+	std::ostringstream oss;
+	oss << "HtMcs" << mcs;
+	wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager","DataMode", StringValue (oss.str ()),
+			"ControlMode", StringValue (oss.str ()));
+
+	Ssid ssid = Ssid ("cisc825-80211nWifi");
+	NetDeviceContainer staDevice;
+	NetDeviceContainer apDevice;
+	if (fastStart) {
+		//Static BSS membership: no beacons, probing or association handshake
+		mac.SetType ("ns3::AdhocWifiMac",
+				"Ssid", SsidValue (ssid));
+		staDevice = wifi.Install (phy, mac, staNode);
+		apDevice = wifi.Install (phy, mac, apNodes);
+	} else {
+		//ns3::StaWifiMac class implements an active probing and association state
+		//machine that handles automatic re-association whenever too many beacons are missed
+		mac.SetType ("ns3::StaWifiMac",
+				"Ssid", SsidValue (ssid),
+				"ActiveProbing", BooleanValue (false));
+		staDevice = wifi.Install (phy, mac, staNode);
+		//ns3::ApWifiMac implements an AP that generates periodic beacons, and that accepts every attempt to associate.
+		mac.SetType ("ns3::ApWifiMac",
+				"Ssid", SsidValue (ssid));
+		apDevice = wifi.Install (phy, mac, apNodes);
+	}
+	//Link specific streams keep the result independent of the order of the links
+	wifi.AssignStreams (NetDeviceContainer (apDevice, staDevice), stream);
+	// Set channel width
+	Config::Set ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/ChannelWidth", UintegerValue (chWidth));
+	// mobility.
+	MobilityHelper mobility;
+	Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator> ();
+	//Place node in position
+	positionAlloc->Add (Vector (0.0, 0.0, 0.0));
+	positionAlloc->Add (Vector (distance, 0.0, 0.0));
+	mobility.SetPositionAllocator (positionAlloc);
+	//Define Mobility Model
+	mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+	//Install Mobility on Nodes
+	mobility.Install (apNodes);
+	mobility.Install (staNode);
+
+	/* Internet stack*/
+	InternetStackHelper stack;
+	Ipv4StaticRoutingHelper staticRouting;
+	if (fastStart) {
+		//The on-link /24 route is installed by static routing when the interface comes up
+		stack.SetRoutingHelper (staticRouting);
+	}
+	stack.Install (apNodes);
+	stack.Install (staNode);
+	//The stack (ARP jitter) draws from the link range too, after the wifi devices
+	stack.AssignStreams (NodeContainer (apNodes, staNode), stream + 32);
+
+	//Set IP Addresses
+	Ipv4AddressHelper address;
+	//Address base
+	/*
+	 * Define IP Address Class
+	 * Mask address is set to 255.255.0.0 to have more addresses for large number of stations
+	 * Also IP address starts from 192.168.0.0 to accommodate more users.
+	 * */
+	address.SetBase ("192.168.1.0", "255.255.255.0");
+	//Interfaces for IP Address
+	Ipv4InterfaceContainer staNodeInterface;
+	Ipv4InterfaceContainer apNodeInterface;
+	//Assign IP Addresses to Nodes
+	staNodeInterface = address.Assign (staDevice);
+	apNodeInterface = address.Assign (apDevice);
+
+	/*
+	 * Setting applications
+	 * We are mainly sending UDP Packet
+	 * */
+	ApplicationContainer serverApp;
+	//UDP Packet flow
+	UdpServerHelper myServer (9);
+	serverApp = myServer.Install (staNode.Get (0));
+	serverApp.Start (Seconds (0.0));
+	serverApp.Stop (Seconds (simulationTime + warmUp));
+	//UDP Client Side
+	UdpClientHelper myClient (staNodeInterface.GetAddress (0), 9);
+	//Set Packet Size, interval and maximum packet
+	myClient.SetAttribute ("MaxPackets", UintegerValue (4294967295u));
+	myClient.SetAttribute ("Interval", TimeValue (Time ("0.00001"))); //packets/s
+	myClient.SetAttribute ("PacketSize", UintegerValue (payLoadSize));
+
+	ApplicationContainer clientApp = myClient.Install (apNodes.Get (0));
+	clientApp.Start (Seconds (warmUp));
+	clientApp.Stop (Seconds (simulationTime + warmUp));
+
+	if (fastStart) {
+		NetDeviceContainer linkDevices;
+		linkDevices.Add (apDevice);
+		linkDevices.Add (staDevice);
+		Ipv4InterfaceContainer linkInterfaces;
+		linkInterfaces.Add (apNodeInterface);
+		linkInterfaces.Add (staNodeInterface);
+		PopulateArpCache (linkDevices, linkInterfaces);
+	} else {
+		Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+	}
+
+	//Per-packet traces go through the ring buffer to the writer thread
+	if (g_packetTrace != 0) {
+		ConnectPacketTraces ();
+	}
+	//Flow statistics keep a fixed size state per flow, no per-packet records
+	FlowMonitorHelper flowHelper;
+	Ptr<FlowMonitor> flowMonitor;
+	if (g_linkStats != 0) {
+		*g_linkStats = LinkStats ();
+		flowMonitor = flowHelper.Install (NodeContainer (apNodes, staNode));
+		Config::ConnectWithoutContext ("/NodeList/*/$ns3::Ipv4L3Protocol/LocalDeliver", MakeCallback (&DelayTrace));
+	}
+
+	//----------------------------------------Network Animation------------------------------------
+	AnimationInterface anim("cisc825-apselectionscheme.xml");
+
+	//LogComponentEnable("InterferenceHelper", LOG_LEVEL_ALL);
+
+	//Run Simulator
+	Simulator::Stop (Seconds (simulationTime + warmUp));
+	Simulator::Run ();
+	if (g_linkStats != 0) {
+		flowMonitor->CheckForLostPackets ();
+		FlowMonitor::FlowStatsContainer flows = flowMonitor->GetFlowStats ();
+		for (FlowMonitor::FlowStatsContainer::const_iterator it = flows.begin (); it != flows.end (); it++) {
+			const FlowMonitor::FlowStats &flow = it->second;
+			g_linkStats->txPackets += flow.txPackets;
+			g_linkStats->rxPackets += flow.rxPackets;
+			g_linkStats->meanDelay += flow.delaySum.GetSeconds ();
+			g_linkStats->meanJitter += flow.jitterSum.GetSeconds ();
+		}
+		uint32_t rx = g_linkStats->rxPackets;
+		g_linkStats->lossRatio = g_linkStats->txPackets > 0 ? 1.0 - (double) rx / g_linkStats->txPackets : 0;
+		g_linkStats->meanDelay = rx > 0 ? g_linkStats->meanDelay / rx : 0;
+		g_linkStats->meanJitter = rx > 1 ? g_linkStats->meanJitter / (rx - 1) : 0;
+		g_linkStats->p50 = g_linkStats->delays.GetQuantile (0.50);
+		g_linkStats->p95 = g_linkStats->delays.GetQuantile (0.95);
+		g_linkStats->p99 = g_linkStats->delays.GetQuantile (0.99);
+	}
+	if (g_memory.WantsLinkCount ()) {
+		g_memory.CountObjects ("first link");
+	}
+	g_memory.TrackLink (NodeContainer (apNodes, staNode));
+	Simulator::Destroy ();
+	g_memory.LinkDone ();
+
+	//Calculate End-to-End Throughput
+	uint32_t totalPacketsThrough = DynamicCast<UdpServer> (serverApp.Get (0))->GetReceived ();
+	return totalPacketsThrough * payLoadSize * 8 / (simulationTime * 1000000.0); //Mbit/s
+}
+
+/* Simulate a group of co-channel BSSs with all their STAs sending saturated UDP
+ * up-link traffic to their AP and return the throughput of every STA in Mbit/s, in
+ * the order of staPositions; staBss[s] is the index in apPositions of the AP of STA s.
+ * Nodes are placed at their deployment positions, so the distances and the hidden
+ * STAs are those of the topology, and the STAs contend through the DCF with their
+ * own BSS and the others of the group on the shared channel. Devices, stack and
+ * fastStart behave as in LinkThroughput; every BSS has its own SSID and each STA
+ * its own UDP server port on its AP.
+ * streams holds the first random stream of every device, the APs then the STAs; a
+ * device draws from its own range whatever the size of the group.
+ * */
+std::vector<double> BssThroughput(const std::vector<Vector> &apPositions, const std::vector<Vector> &staPositions,
+		const std::vector<uint32_t> &staBss, const std::vector<int> &payLoadSizes, int mcs, uint32_t chWidth, bool sgi,
+		double simulationTime, bool fastStart, const std::vector<int64_t> &streams){
+	double warmUp = fastStart ? 0.0 : 1.0;
+	uint32_t nSta = staPositions.size();
+	uint32_t nAp = apPositions.size();
+	NodeContainer staNodes;
+	staNodes.Create (nSta);
+	NodeContainer apNodes;
+	apNodes.Create (nAp);
+	YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+	YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+	phy.SetChannel (channel.Create ());
+	phy.Set ("ShortGuardEnabled", BooleanValue (sgi));
+	WifiMacHelper mac;
+	WifiHelper wifi;
+	wifi.SetStandard (WIFI_PHY_STANDARD_80211n_2_4GHZ);
+	std::ostringstream oss;
+	oss << "HtMcs" << mcs;
+	wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager","DataMode", StringValue (oss.str ()),
+			"ControlMode", StringValue (oss.str ()));
+
+	NetDeviceContainer staDevices;
+	NetDeviceContainer apDevice;
+	if (fastStart) {
+		Ssid ssid = Ssid ("cisc825-80211nWifi");
+		mac.SetType ("ns3::AdhocWifiMac",
+				"Ssid", SsidValue (ssid));
+		staDevices = wifi.Install (phy, mac, staNodes);
+		apDevice = wifi.Install (phy, mac, apNodes);
+	} else {
+		//STA devices are installed BSS by BSS and then put back in STA order
+		std::vector<Ptr<NetDevice> > byStation (nSta);
+		for (uint32_t b = 0; b < nAp; b++) {
+			std::ostringstream name;
+			name << "cisc825-80211nWifi-" << b;
+			Ssid ssid = Ssid (name.str ());
+			NodeContainer bssStations;
+			std::vector<uint32_t> bssIndex;
+			for (uint32_t s = 0; s < nSta; s++) {
+				if (staBss[s] == b) {
+					bssStations.Add (staNodes.Get (s));
+					bssIndex.push_back (s);
+				}
+			}
+			mac.SetType ("ns3::StaWifiMac",
+					"Ssid", SsidValue (ssid),
+					"ActiveProbing", BooleanValue (false));
+			NetDeviceContainer bssDevices = wifi.Install (phy, mac, bssStations);
+			for (uint32_t m = 0; m < bssIndex.size (); m++) {
+				byStation[bssIndex[m]] = bssDevices.Get (m);
+			}
+			mac.SetType ("ns3::ApWifiMac",
+					"Ssid", SsidValue (ssid));
+			apDevice.Add (wifi.Install (phy, mac, apNodes.Get (b)));
+		}
+		for (uint32_t s = 0; s < nSta; s++) {
+			staDevices.Add (byStation[s]);
+		}
+	}
+	for (uint32_t b = 0; b < nAp; b++) {
+		wifi.AssignStreams (NetDeviceContainer (apDevice.Get (b)), streams[b]);
+	}
+	for (uint32_t s = 0; s < nSta; s++) {
+		wifi.AssignStreams (NetDeviceContainer (staDevices.Get (s)), streams[nAp + s]);
+	}
+	Config::Set ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/ChannelWidth", UintegerValue (chWidth));
+	MobilityHelper mobility;
+	Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator> ();
+	for (uint32_t b = 0; b < nAp; b++) {
+		positionAlloc->Add (apPositions[b]);
+	}
+	for (uint32_t s = 0; s < nSta; s++) {
+		positionAlloc->Add (staPositions[s]);
+	}
+	mobility.SetPositionAllocator (positionAlloc);
+	mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+	mobility.Install (apNodes);
+	mobility.Install (staNodes);
+
+	InternetStackHelper stack;
+	Ipv4StaticRoutingHelper staticRouting;
+	if (fastStart) {
+		stack.SetRoutingHelper (staticRouting);
+	}
+	stack.Install (apNodes);
+	stack.Install (staNodes);
+	//The stack of a node draws from the range of its device, after the wifi streams
+	for (uint32_t b = 0; b < nAp; b++) {
+		stack.AssignStreams (NodeContainer (apNodes.Get (b)), streams[b] + 32);
+	}
+	for (uint32_t s = 0; s < nSta; s++) {
+		stack.AssignStreams (NodeContainer (staNodes.Get (s)), streams[nAp + s] + 32);
+	}
+	//A BSS may hold more STAs than a /24 has addresses
+	Ipv4AddressHelper address;
+	address.SetBase ("192.168.0.0", "255.255.0.0");
+	Ipv4InterfaceContainer staInterfaces = address.Assign (staDevices);
+	Ipv4InterfaceContainer apInterface = address.Assign (apDevice);
+
+	//One server port per STA on its AP, and a saturated client on every STA
+	ApplicationContainer serverApps;
+	for (uint32_t s = 0; s < nSta; s++) {
+		UdpServerHelper myServer (9 + s);
+		serverApps.Add (myServer.Install (apNodes.Get (staBss[s])));
+		UdpClientHelper myClient (apInterface.GetAddress (staBss[s]), 9 + s);
+		myClient.SetAttribute ("MaxPackets", UintegerValue (4294967295u));
+		myClient.SetAttribute ("Interval", TimeValue (Time ("0.00001")));
+		myClient.SetAttribute ("PacketSize", UintegerValue (payLoadSizes[s]));
+		ApplicationContainer clientApp = myClient.Install (staNodes.Get (s));
+		clientApp.Start (Seconds (warmUp));
+		clientApp.Stop (Seconds (simulationTime + warmUp));
+	}
+	serverApps.Start (Seconds (0.0));
+	serverApps.Stop (Seconds (simulationTime + warmUp));
+
+	if (fastStart) {
+		NetDeviceContainer bssDevices;
+		bssDevices.Add (apDevice);
+		bssDevices.Add (staDevices);
+		Ipv4InterfaceContainer bssInterfaces;
+		bssInterfaces.Add (apInterface);
+		bssInterfaces.Add (staInterfaces);
+		PopulateArpCache (bssDevices, bssInterfaces);
+	} else {
+		Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+	}
+
+	Simulator::Stop (Seconds (simulationTime + warmUp));
+	Simulator::Run ();
+	Simulator::Destroy ();
+
+	std::vector<double> throughput (nSta);
+	for (uint32_t s = 0; s < nSta; s++) {
+		uint32_t received = DynamicCast<UdpServer> (serverApps.Get (s))->GetReceived ();
+		throughput[s] = received * payLoadSizes[s] * 8 / (simulationTime * 1000000.0); //Mbit/s
+	}
+	return throughput;
+}
+
+/* Run the contention simulation of every group of BSSs, at most workers at a time,
+ * each in a forked process, and return the up-link throughput of every STA in Mbit/s
+ * members[ap] lists the STAs associated with AP ap and groups the APs simulated
+ * together: one AP per group, or the BSSs of a connected component of the conflict
+ * graph, which cannot hear the other groups. A child sends its results back through
+ * a pipe; children are collected in launch order, so a child blocked on a full pipe
+ * only waits for the ones started before it. STAs of a failed group are reported
+ * with a negative throughput. Per-packet tracing stays in the parent, the children
+ * run without it.
+ * */
+std::vector<double> ParallelBssThroughput(const std::vector<std::vector<uint32_t> > &members,
+		const std::vector<std::vector<uint32_t> > &groups, NodeContainer apNodes, NodeContainer staNodes,
+		double simulationTime, bool fastStart, uint32_t workers){
+	struct Job {
+		uint32_t group;
+		std::vector<uint32_t> stations;
+		pid_t pid;
+		int fd;
+	};
+	std::vector<double> throughput (staNodes.GetN (), -1.0);
+	std::vector<Job> running;
+	uint32_t next = 0;
+	workers = std::max (workers, 1u);
+	while (next < groups.size () || !running.empty ()) {
+		//Launch up to workers group simulations
+		while (running.size () < workers && next < groups.size ()) {
+			uint32_t group = next++;
+			std::vector<Vector> apPositions;
+			std::vector<Vector> staPositions;
+			std::vector<uint32_t> staBss;
+			std::vector<int> payLoadSizes;
+			std::vector<uint32_t> stations;
+			//One RNG_BSS id per device, fixed by the AP or STA and not by the group
+			std::vector<int64_t> streams, staStreams;
+			for (uint32_t g = 0; g < groups[group].size (); g++) {
+				uint32_t ap = groups[group][g];
+				if (members[ap].empty ()) {
+					continue;
+				}
+				for (uint32_t m = 0; m < members[ap].size (); m++) {
+					uint32_t st = members[ap][m];
+					stations.push_back (st);
+					staPositions.push_back (staNodes.Get (st)->GetObject<MobilityModel> ()->GetPosition ());
+					staBss.push_back (apPositions.size ());
+					payLoadSizes.push_back (payLoadSizeGenerator (500, 1400, st));
+					staStreams.push_back (g_rng.GetStream (RNG_BSS, st));
+				}
+				apPositions.push_back (apNodes.Get (ap)->GetObject<MobilityModel> ()->GetPosition ());
+				streams.push_back (g_rng.GetStream (RNG_BSS, (uint64_t) staNodes.GetN () + ap));
+			}
+			if (stations.empty ()) {
+				continue;
+			}
+			streams.insert (streams.end (), staStreams.begin (), staStreams.end ());
+			int fds[2];
+			if (pipe (fds) != 0) {
+				cout << "Unable to create the pipe of BSS group " << group << endl;
+				continue;
+			}
+			pid_t pid = fork ();
+			if (pid == 0) {
+				close (fds[0]);
+				g_packetTrace = 0;
+				std::vector<double> result = BssThroughput (apPositions, staPositions, staBss, payLoadSizes, 0, 20, false,
+						simulationTime, fastStart, streams);
+				size_t bytes = result.size () * sizeof (double);
+				const char *data = reinterpret_cast<const char *> (&result[0]);
+				while (bytes > 0) {
+					ssize_t n = write (fds[1], data, bytes);
+					if (n <= 0) {
+						_exit (1);
+					}
+					data += n;
+					bytes -= n;
+				}
+				_exit (0);
+			}
+			close (fds[1]);
+			if (pid < 0) {
+				cout << "Unable to start the simulation of BSS group " << group << endl;
+				close (fds[0]);
+				continue;
+			}
+			Job job = {group, stations, pid, fds[0]};
+			running.push_back (job);
+		}
+		if (running.empty ()) {
+			continue;
+		}
+		//Collect the oldest simulation
+		Job job = running.front ();
+		running.erase (running.begin ());
+		std::vector<double> result (job.stations.size ());
+		size_t bytes = result.size () * sizeof (double), got = 0;
+		char *data = reinterpret_cast<char *> (&result[0]);
+		ssize_t n;
+		while (got < bytes && (n = read (job.fd, data + got, bytes - got)) > 0) {
+			got += n;
+		}
+		close (job.fd);
+		int status = 0;
+		waitpid (job.pid, &status, 0);
+		if (got != bytes || !WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+			cout << "Simulation of BSS group " << job.group << " failed" << endl;
+			continue;
+		}
+		for (uint32_t m = 0; m < job.stations.size (); m++) {
+			throughput[job.stations[m]] = result[m];
+		}
+	}
+	return throughput;
+}
+
+
+//-----------------------------------Incremental Re-runs---------------------------------------
+/*FNV-1a hash of the inputs of a pipeline stage
+ * A stage hash starts from the hash of the stage it depends on, so a change
+ * upstream invalidates everything below it.
+ * */
+class StageHash {
+public:
+	StageHash() : m_hash(14695981039346656037ULL) {}
+	StageHash &Add(const void *data, size_t bytes) {
+		const unsigned char *b = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < bytes; i++) {
+			m_hash = (m_hash ^ b[i]) * 1099511628211ULL;
+		}
+		return *this;
+	}
+	StageHash &Add(std::string text) { return Add(text.data(), text.size()); }
+	StageHash &Add(double value) { return Add(&value, sizeof(value)); }
+	StageHash &Add(uint64_t value) { return Add(&value, sizeof(value)); }
+	uint64_t Get() const { return m_hash; }
+	std::string GetHex() const {
+		char hex[17];
+		snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) m_hash);
+		return hex;
+	}
+private:
+	uint64_t m_hash;
+};
+
+/*Result of one link simulation as kept in the link cache
+ * */
+struct LinkRecord {
+	uint64_t hash;
+	double throughput;
+	uint32_t txPackets;
+	uint32_t rxPackets;
+	double lossRatio;
+	double meanDelay;
+	double meanJitter;
+	double p50;
+	double p95;
+	double p99;
+};
+
+/* Stage outputs of earlier runs, kept in a run directory under their input hash
+ * Each stage is one raw file <stage>-<hash>.bin, written to a temporary name and
+ * renamed so an interrupted run never leaves a truncated stage behind. Link results
+ * are appended as fixed size records to links.bin and read once per run.
+ * An empty run directory disables the cache.
+ * */
+class StageCache {
+public:
+	StageCache(std::string runDir);
+	bool IsEnabled() const;
+	bool Load(std::string stage, const StageHash &hash, void *data, uint64_t bytes) const;
+	void Store(std::string stage, const StageHash &hash, const void *data, uint64_t bytes) const;
+	bool FindLink(uint64_t hash, LinkRecord &record);
+	void StoreLink(const LinkRecord &record);
+	//Record in stages.txt whether a stage was reused or computed
+	void Note(std::string stage, const StageHash &hash, bool reused) const;
+private:
+	std::string StagePath(std::string stage, const StageHash &hash) const;
+	std::string m_runDir;
+	bool m_linksLoaded;
+	std::map<uint64_t, LinkRecord> m_links;
+};
+
+StageCache::StageCache(std::string runDir) : m_runDir(runDir), m_linksLoaded(false) {
+	if (!m_runDir.empty()) {
+		mkdir(m_runDir.c_str(), 0755);
+	}
+}
+
+bool StageCache::IsEnabled() const {
+	return !m_runDir.empty();
+}
+
+std::string StageCache::StagePath(std::string stage, const StageHash &hash) const {
+	return m_runDir + "/" + stage + "-" + hash.GetHex() + ".bin";
+}
+
+bool StageCache::Load(std::string stage, const StageHash &hash, void *data, uint64_t bytes) const {
+	if (!IsEnabled()) {
+		return false;
+	}
+	ifstream in(StagePath(stage, hash).c_str(), ifstream::binary);
+	if (!in.is_open()) {
+		return false;
+	}
+	in.read(static_cast<char *>(data), bytes);
+	//A stage of the wrong size is recomputed
+	return (uint64_t) in.gcount() == bytes && in.peek() == EOF;
+}
+
+void StageCache::Store(std::string stage, const StageHash &hash, const void *data, uint64_t bytes) const {
+	if (!IsEnabled()) {
+		return;
+	}
+	std::string path = StagePath(stage, hash);
+	//Shards share the run directory, each writes its own temporary file
+	std::ostringstream tmp;
+	tmp << path << "." << getpid() << ".tmp";
+	ofstream out(tmp.str().c_str(), ofstream::binary);
+	if (!out.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store stage " << stage << " in the run directory" << endl;
+		return;
+	}
+	out.write(static_cast<const char *>(data), bytes);
+	out.close();
+	rename(tmp.str().c_str(), path.c_str());
+}
+
+bool StageCache::FindLink(uint64_t hash, LinkRecord &record) {
+	if (!m_linksLoaded) {
+		m_linksLoaded = true;
+		ifstream in((m_runDir + "/links.bin").c_str(), ifstream::binary);
+		LinkRecord r;
+		while (in.read(reinterpret_cast<char *>(&r), sizeof(r))) {
+			m_links[r.hash] = r;
+		}
+	}
+	std::map<uint64_t, LinkRecord>::const_iterator it = m_links.find(hash);
+	if (it == m_links.end()) {
+		return false;
+	}
+	record = it->second;
+	return true;
+}
+
+void StageCache::StoreLink(const LinkRecord &record) {
+	m_links[record.hash] = record;
+	ofstream out((m_runDir + "/links.bin").c_str(), ofstream::binary | ofstream::app);
+	if (out.is_open()) {
+		out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+		out.close();
+	} else {
+		//Throw Error Exception
+		cout << "Unable to store the link result in the run directory" << endl;
+	}
+}
+
+void StageCache::Note(std::string stage, const StageHash &hash, bool reused) const {
+	if (!IsEnabled()) {
+		return;
+	}
+	cout << "Stage " << stage << " " << hash.GetHex() << (reused ? " reused" : " computed") << endl;
+	ofstream st((m_runDir + "/stages.txt").c_str(), ofstream::app);
+	if (st.is_open()) {
+		st << stage << "\t" << hash.GetHex() << "\t" << (reused ? "reused" : "computed") << endl;
+		st.close();
+	}
+}
+
+/* LinkThroughput through the link cache of the run directory
+ * A link whose inputs were simulated before is read back, together with its flow
+ * statistics when g_linkStats is set (the delay histogram itself is not kept).
+ * While packets are traced every link is simulated, a cached one has no packets.
+ * */
+double CachedLinkThroughput(StageCache &cache, double distance, int payLoadSize, int mcs, uint32_t chWidth, bool sgi,
+		double simulationTime, bool fastStart, int64_t stream){
+	if (!cache.IsEnabled() || g_packetTrace != 0) {
+		return LinkThroughput (distance, payLoadSize, mcs, chWidth, sgi, simulationTime, fastStart, stream);
+	}
+	StageHash hash;
+	hash.Add(std::string("link-v2")).Add(distance).Add((uint64_t) payLoadSize).Add((uint64_t) mcs)
+			.Add((uint64_t) chWidth).Add((uint64_t) sgi).Add(simulationTime).Add((uint64_t) fastStart)
+			.Add((uint64_t) stream).Add((uint64_t) RngSeedManager::GetSeed()).Add((uint64_t) RngSeedManager::GetRun())
+			.Add((uint64_t) (g_linkStats != 0));
+	LinkRecord record;
+	if (cache.FindLink(hash.Get(), record)) {
+		if (g_linkStats != 0) {
+			*g_linkStats = LinkStats ();
+			g_linkStats->txPackets = record.txPackets;
+			g_linkStats->rxPackets = record.rxPackets;
+			g_linkStats->lossRatio = record.lossRatio;
+			g_linkStats->meanDelay = record.meanDelay;
+			g_linkStats->meanJitter = record.meanJitter;
+			g_linkStats->p50 = record.p50;
+			g_linkStats->p95 = record.p95;
+			g_linkStats->p99 = record.p99;
+		}
+		return record.throughput;
+	}
+	record = LinkRecord ();
+	record.hash = hash.Get();
+	record.throughput = LinkThroughput (distance, payLoadSize, mcs, chWidth, sgi, simulationTime, fastStart, stream);
+	if (g_linkStats != 0) {
+		record.txPackets = g_linkStats->txPackets;
+		record.rxPackets = g_linkStats->rxPackets;
+		record.lossRatio = g_linkStats->lossRatio;
+		record.meanDelay = g_linkStats->meanDelay;
+		record.meanJitter = g_linkStats->meanJitter;
+		record.p50 = g_linkStats->p50;
+		record.p95 = g_linkStats->p95;
+		record.p99 = g_linkStats->p99;
+	}
+	cache.StoreLink(record);
+	return record.throughput;
+}
+
+//-----------------------------------Stratified Sampling---------------------------------------
+/*Two sided 97.5% quantile of Student's t distribution
+ * */
+double StudentT975(uint32_t df){
+	static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+			2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+	return df == 0 ? INFINITY : df <= 30 ? table[df - 1] : 1.96;
+}
+
+/* Stratified sampling of the link simulations
+ * STAs are grouped by distance band and payload bucket; only the first perStratum
+ * STAs of a stratum are simulated. The others get an estimate from the simulated
+ * ones: a least squares line in payload size when the samples hold at least three
+ * distinct sizes, the stratum mean otherwise, each with a 95% confidence interval
+ * of the expected throughput at that payload.
+ * */
+class StratifiedSampler {
+public:
+	StratifiedSampler(double distanceBand, int payloadBucket, uint32_t perStratum);
+	//Place a STA in its stratum, true when it must be simulated
+	bool Add(uint32_t sta, double distance, int payLoadSize);
+	void SetResult(uint32_t sta, double throughput);
+	//Fit every stratum once all samples have results
+	void Estimate();
+	bool IsSampled(uint32_t sta) const;
+	//Simulated throughput of a sampled STA, estimate of the others
+	double GetThroughput(uint32_t sta) const;
+	//Half width of the 95% interval, 0 for sampled STAs and infinite for a single sample
+	double GetHalfWidth(uint32_t sta) const;
+	uint32_t GetSimulated() const;
+	void Write(std::string fileName) const;
+private:
+	typedef std::pair<int, int> Key;
+	struct Stratum {
+		std::vector<uint32_t> members;
+		std::vector<uint32_t> samples;
+		//throughput = intercept + slope * (payload - meanPayload)
+		double intercept;
+		double slope;
+		double meanPayload;
+		double sxx;
+		double residualSd;
+		uint32_t df;
+	};
+	struct Member {
+		Key key;
+		int payLoadSize;
+		bool sampled;
+		double throughput;
+	};
+	double m_distanceBand;
+	int m_payloadBucket;
+	uint32_t m_perStratum;
+	std::map<Key, Stratum> m_strata;
+	std::map<uint32_t, Member> m_members;
+};
+
+StratifiedSampler::StratifiedSampler(double distanceBand, int payloadBucket, uint32_t perStratum)
+	: m_distanceBand(distanceBand), m_payloadBucket(payloadBucket), m_perStratum(perStratum) {
+}
+
+bool StratifiedSampler::Add(uint32_t sta, double distance, int payLoadSize) {
+	Key key((int) (distance / m_distanceBand), payLoadSize / m_payloadBucket);
+	Stratum &stratum = m_strata[key];
+	Member member = {key, payLoadSize, stratum.samples.size() < m_perStratum, 0};
+	stratum.members.push_back(sta);
+	if (member.sampled) {
+		stratum.samples.push_back(sta);
+	}
+	m_members[sta] = member;
+	return member.sampled;
+}
+
+void StratifiedSampler::SetResult(uint32_t sta, double throughput) {
+	m_members[sta].throughput = throughput;
+}
+
+void StratifiedSampler::Estimate() {
+	for (std::map<Key, Stratum>::iterator it = m_strata.begin(); it != m_strata.end(); it++) {
+		Stratum &s = it->second;
+		uint32_t n = s.samples.size();
+		double meanY = 0;
+		s.meanPayload = 0;
+		std::set<int> sizes;
+		for (uint32_t i = 0; i < n; i++) {
+			const Member &m = m_members[s.samples[i]];
+			meanY += m.throughput / n;
+			s.meanPayload += (double) m.payLoadSize / n;
+			sizes.insert(m.payLoadSize);
+		}
+		s.sxx = 0;
+		double sxy = 0;
+		for (uint32_t i = 0; i < n; i++) {
+			const Member &m = m_members[s.samples[i]];
+			s.sxx += (m.payLoadSize - s.meanPayload) * (m.payLoadSize - s.meanPayload);
+			sxy += (m.payLoadSize - s.meanPayload) * (m.throughput - meanY);
+		}
+		bool line = sizes.size() >= 3;
+		s.intercept = meanY;
+		s.slope = line ? sxy / s.sxx : 0;
+		s.df = n - (line ? 2 : 1);
+		double sse = 0;
+		for (uint32_t i = 0; i < n; i++) {
+			const Member &m = m_members[s.samples[i]];
+			double r = m.throughput - s.intercept - s.slope * (m.payLoadSize - s.meanPayload);
+			sse += r * r;
+		}
+		s.residualSd = s.df > 0 ? sqrt(sse / s.df) : INFINITY;
+		if (!line) {
+			s.sxx = 0;
+		}
+	}
+	for (std::map<uint32_t, Member>::iterator it = m_members.begin(); it != m_members.end(); it++) {
+		Member &m = it->second;
+		if (!m.sampled) {
+			const Stratum &s = m_strata[m.key];
+			m.throughput = s.intercept + s.slope * (m.payLoadSize - s.meanPayload);
+		}
+	}
+}
+
+bool StratifiedSampler::IsSampled(uint32_t sta) const {
+	std::map<uint32_t, Member>::const_iterator it = m_members.find(sta);
+	return it != m_members.end() && it->second.sampled;
+}
+
+double StratifiedSampler::GetThroughput(uint32_t sta) const {
+	return m_members.find(sta)->second.throughput;
+}
+
+double StratifiedSampler::GetHalfWidth(uint32_t sta) const {
+	const Member &m = m_members.find(sta)->second;
+	if (m.sampled) {
+		return 0;
+	}
+	const Stratum &s = m_strata.find(m.key)->second;
+	double x = m.payLoadSize - s.meanPayload;
+	double leverage = 1.0 / s.samples.size() + (s.sxx > 0 ? x * x / s.sxx : 0);
+	return StudentT975(s.df) * s.residualSd * sqrt(leverage);
+}
+
+uint32_t StratifiedSampler::GetSimulated() const {
+	uint32_t simulated = 0;
+	for (std::map<Key, Stratum>::const_iterator it = m_strata.begin(); it != m_strata.end(); it++) {
+		simulated += it->second.samples.size();
+	}
+	return simulated;
+}
+
+void StratifiedSampler::Write(std::string fileName) const {
+	ofstream ss;
+	ss.open(fileName.c_str());
+	if (!ss.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the sampling strata in file" << endl;
+		return;
+	}
+	ss << "DistanceFrom(m)\tDistanceTo(m)\tPayloadFrom\tPayloadTo\tSTAs\tSimulated\tMean(Mbps)\tCI95" << endl;
+	for (std::map<Key, Stratum>::const_iterator it = m_strata.begin(); it != m_strata.end(); it++) {
+		const Stratum &s = it->second;
+		ss << it->first.first * m_distanceBand << "\t" << (it->first.first + 1) * m_distanceBand << "\t"
+				<< it->first.second * m_payloadBucket << "\t" << (it->first.second + 1) * m_payloadBucket << "\t"
+				<< s.members.size() << "\t" << s.samples.size() << "\t" << s.intercept << "\t"
+				<< StudentT975(s.df) * s.residualSd / sqrt((double) s.samples.size()) << endl;
+	}
+	ss.close();
+}
+
+//-----------------------------------Channel Planning---------------------------------------
+/*Non-overlapping 20 MHz channels of the band
+ * */
+std::vector<uint32_t> AvailableChannels(double freqBand){
+	static const uint32_t band2_4[] = {1, 6, 11};
+	static const uint32_t band5[] = {36, 40, 44, 48, 52, 56, 60, 64, 100, 104, 108, 112, 116, 120, 124,
+			128, 132, 136, 140, 149, 153, 157, 161, 165};
+	if (freqBand > 3) {
+		return std::vector<uint32_t>(band5, band5 + sizeof(band5) / sizeof(band5[0]));
+	}
+	return std::vector<uint32_t>(band2_4, band2_4 + sizeof(band2_4) / sizeof(band2_4[0]));
+}
+
+/* Colour the AP conflict graph with nChannels channels
+ * conflictMw[a * nAPs + b] is the power AP a receives from AP b.
+ * Greedy start: APs in decreasing order of total conflict take the channel with the
+ * least co-channel power from the APs already placed. Local search then moves one AP
+ * at a time to its best channel until a pass brings no improvement.
+ * Returns the channel index of every AP.
+ * */
+std::vector<uint32_t> PlanChannels(const std::vector<double> &conflictMw, uint32_t nAPs, uint32_t nChannels, uint32_t maxPasses){
+	std::vector<uint32_t> channel(nAPs, 0);
+	std::vector<bool> placed(nAPs, false);
+	std::vector<std::pair<double, uint32_t> > order(nAPs);
+	for (uint32_t a = 0; a < nAPs; a++) {
+		double total = 0;
+		for (uint32_t b = 0; b < nAPs; b++) {
+			total += (a == b) ? 0 : conflictMw[a * nAPs + b] + conflictMw[b * nAPs + a];
+		}
+		order[a] = std::make_pair(-total, a);
+	}
+	std::sort(order.begin(), order.end());
+	std::vector<double> cost(nChannels);
+	for (uint32_t o = 0; o < nAPs; o++) {
+		uint32_t a = order[o].second;
+		std::fill(cost.begin(), cost.end(), 0.0);
+		for (uint32_t b = 0; b < nAPs; b++) {
+			if (placed[b] && b != a) {
+				cost[channel[b]] += conflictMw[a * nAPs + b] + conflictMw[b * nAPs + a];
+			}
+		}
+		channel[a] = std::min_element(cost.begin(), cost.end()) - cost.begin();
+		placed[a] = true;
+	}
+	for (uint32_t pass = 0; pass < maxPasses; pass++) {
+		bool improved = false;
+		for (uint32_t a = 0; a < nAPs; a++) {
+			std::fill(cost.begin(), cost.end(), 0.0);
+			for (uint32_t b = 0; b < nAPs; b++) {
+				if (b != a) {
+					cost[channel[b]] += conflictMw[a * nAPs + b] + conflictMw[b * nAPs + a];
+				}
+			}
+			uint32_t best = std::min_element(cost.begin(), cost.end()) - cost.begin();
+			if (cost[best] < cost[channel[a]]) {
+				channel[a] = best;
+				improved = true;
+			}
+		}
+		if (!improved) {
+			break;
+		}
+	}
+	return channel;
+}
+
+//Number of Access Points, set by --numAPs or a benchmark scenario
+uint32_t numAPs = 15;
+//Number of Stations, set by --numSTAs or a benchmark scenario
+uint32_t numSTAs = 300;
+//Association variable x_ij = 1 if STA_i associates with STA_j, x_ij = 0 otherwise
+int x_ij = 0; //Binary variable indicating association
+
+//-----------------------------------Sharded Execution---------------------------------------
+/*Subset of the STAs handled by one process: STA s belongs to shard s % count.
+ * Every shard rebuilds the same topology and association from the per-entity random
+ * streams and only runs the link simulations of its own STAs.
+ * */
+struct ShardSpec {
+	uint32_t index;
+	uint32_t count;
+};
+
+/*Parse "i/n" into a shard specification
+ * */
+bool ParseShard(std::string text, ShardSpec &shard){
+	unsigned int index, count;
+	char tail;
+	if (sscanf(text.c_str(), "%u/%u%c", &index, &count, &tail) != 2 || count == 0 || index >= count) {
+		return false;
+	}
+	shard.index = index;
+	shard.count = count;
+	return true;
+}
+
+bool InShard(const ShardSpec &shard, uint32_t sta){
+	return sta % shard.count == shard.index;
+}
+
+/*Working directory of shard k, all outputs of the shard land there
+ * */
+std::string ShardDirectory(std::string shardDir, uint32_t k){
+	std::ostringstream name;
+	name << shardDir << "/shard_" << k;
+	return name.str();
+}
+
+std::string JobLockName(std::string shardDir, uint32_t k){
+	std::ostringstream name;
+	name << shardDir << "/job_" << k << ".lock";
+	return name.str();
+}
+
+/*Record the owner of a held lock: host, worker pid and the pid of the shard child
+ * */
+void WriteJobOwner(std::string lockName, pid_t child){
+	int fd = open(lockName.c_str(), O_WRONLY | O_TRUNC);
+	if (fd < 0) {
+		return;
+	}
+	char host[256] = "";
+	gethostname(host, sizeof(host) - 1);
+	std::ostringstream owner;
+	owner << host << " " << getpid() << " " << child << endl;
+	if (write(fd, owner.str().c_str(), owner.str().size()) < 0) {
+		cout << "Unable to record the owner of " << lockName << endl;
+	}
+	close(fd);
+}
+
+/*Claim job k of the queue in shardDir
+ * The lock file is created with O_EXCL, which is atomic on a local or NFSv3+
+ * filesystem, so exactly one worker on any host wins it.
+ * */
+bool ClaimJob(std::string shardDir, uint32_t k){
+	std::string name = JobLockName(shardDir, k);
+	int fd = open(name.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	close(fd);
+	WriteJobOwner(name, 0);
+	return true;
+}
+
+/*Release job k so another worker can retry it
+ * */
+void ReleaseJob(std::string shardDir, uint32_t k){
+	unlink(JobLockName(shardDir, k).c_str());
+}
+
+/*A lock is stale when its owner is gone: on this host neither the worker nor its
+ * shard child is alive, on any host the owner stopped renewing it for leaseSeconds
+ * */
+bool IsStaleLock(std::string lockName, double leaseSeconds){
+	struct stat info;
+	if (stat(lockName.c_str(), &info) != 0) {
+		return false;
+	}
+	if (difftime(time(0), info.st_mtime) > leaseSeconds) {
+		return true;
+	}
+	ifstream lock(lockName.c_str());
+	std::string owner;
+	long worker = 0, child = 0;
+	if (!(lock >> owner >> worker)) {
+		return false;
+	}
+	lock >> child;
+	char host[256] = "";
+	gethostname(host, sizeof(host) - 1);
+	if (owner != host) {
+		return false;
+	}
+	bool workerAlive = kill((pid_t) worker, 0) == 0 || errno == EPERM;
+	bool childAlive = child > 0 && (kill((pid_t) child, 0) == 0 || errno == EPERM);
+	return !workerAlive && !childAlive;
+}
+
+/*Take over the stale lock of job k
+ * The lock is first renamed to a name private to this worker, so of several workers
+ * recovering it only one gets it; a lock that turns out to be live after the rename
+ * (renewed or re-created meanwhile) is put back.
+ * */
+bool RecoverJob(std::string shardDir, uint32_t k, double leaseSeconds){
+	std::string name = JobLockName(shardDir, k);
+	std::ostringstream aside;
+	aside << name << "." << getpid();
+	if (rename(name.c_str(), aside.str().c_str()) != 0) {
+		return false;
+	}
+	if (!IsStaleLock(aside.str(), leaseSeconds)) {
+		if (link(aside.str().c_str(), name.c_str()) != 0) {
+			cout << "Lock of shard " << k << " was replaced while it was checked" << endl;
+		}
+		unlink(aside.str().c_str());
+		return false;
+	}
+	unlink(aside.str().c_str());
+	cout << "Recovered the stale lock of shard " << k << endl;
+	return ClaimJob(shardDir, k);
+}
+
+/* Pull shards of the job queue in shardDir until every shard is complete
+ * Each claimed shard runs in a forked child; the function returns true in that child
+ * with shard set, and false in the worker once all shards have ShardComplete.txt.
+ * While its child runs, the worker renews the lock every leaseSeconds / 4; a shard
+ * whose child fails is released and claimed again on a later pass, by this or any
+ * other worker, and locks left by dead or silent workers are recovered. A worker
+ * stops retrying a shard after maxAttempts failures of its own, and returns once
+ * only such shards are left.
+ * */
+bool RunJobQueue(std::string shardDir, uint32_t count, ShardSpec &shard, double leaseSeconds){
+	const uint32_t maxAttempts = 3;
+	mkdir(shardDir.c_str(), 0755);
+	std::vector<uint32_t> failures(count, 0);
+	while (true) {
+		uint32_t incomplete = 0, givenUp = 0;
+		bool ran = false;
+		for (uint32_t k = 0; k < count; k++) {
+			struct stat info;
+			if (stat((ShardDirectory(shardDir, k) + "/ShardComplete.txt").c_str(), &info) == 0) {
+				continue;
+			}
+			incomplete++;
+			if (failures[k] >= maxAttempts) {
+				givenUp++;
+				continue;
+			}
+			if (!ClaimJob(shardDir, k)
+					&& !(IsStaleLock(JobLockName(shardDir, k), leaseSeconds) && RecoverJob(shardDir, k, leaseSeconds))) {
+				continue;
+			}
+			//A shard completed by another worker between the check and the claim
+			if (stat((ShardDirectory(shardDir, k) + "/ShardComplete.txt").c_str(), &info) == 0) {
+				continue;
+			}
+			ran = true;
+			pid_t pid = fork();
+			if (pid == 0) {
+				shard.index = k;
+				shard.count = count;
+				return true;
+			}
+			int status = 0;
+			bool ok = pid > 0;
+			if (ok) {
+				WriteJobOwner(JobLockName(shardDir, k), pid);
+				pid_t done;
+				time_t renewed = time(0);
+				while ((done = waitpid(pid, &status, WNOHANG)) == 0) {
+					sleep(1);
+					if (difftime(time(0), renewed) >= leaseSeconds / 4) {
+						//Renewing the modification time keeps the lease
+						utime(JobLockName(shardDir, k).c_str(), 0);
+						renewed = time(0);
+					}
+				}
+				ok = done == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			}
+			if (!ok) {
+				failures[k]++;
+				cout << "Shard " << k << "/" << count << " failed, releasing it" << endl;
+				ReleaseJob(shardDir, k);
+			} else {
+				cout << "Shard " << k << "/" << count << " done" << endl;
+			}
+		}
+		if (incomplete == 0) {
+			return false;
+		}
+		if (incomplete == givenUp) {
+			cout << givenUp << " shards failed " << maxAttempts << " times in this worker, leaving them" << endl;
+			return false;
+		}
+		if (!ran) {
+			//The remaining shards are held by other workers, wait for them to finish or go stale
+			sleep(5);
+		}
+	}
+}
+
+/*Outputs computed before the link simulations, identical in every shard
+ * */
+static const char *sharedOutputs[] = {"DistanceSTAAP.txt", "SSF_UL_RSS_Assoc.txt", "UL_AssociationDistance.txt",
+		"UL_SINR_Assoc.txt", "DL_AssociationDistance.txt", "SSF_DL_RSS_Assoc.txt", "STAsperAP.txt",
+		"APChannelPlan.txt", "RngStreams.txt"};
+
+/* Combine the LinkResults.txt of every shard into the canonical trace files
+ * Fails, leaving no canonical output, when a shard is not complete or a STA has no
+ * result, and returns the process exit status.
+ * */
+int MergeShards(std::string shardDir, uint32_t count){
+	std::vector<std::string> lines(numSTAs);
+	std::vector<bool> seen(numSTAs, false);
+	for (uint32_t k = 0; k < count; k++) {
+		std::string dir = ShardDirectory(shardDir, k);
+		ifstream done((dir + "/ShardComplete.txt").c_str());
+		if (!done.is_open()) {
+			cout << "Shard " << k << "/" << count << " is not complete" << endl;
+			return 1;
+		}
+		ifstream results((dir + "/LinkResults.txt").c_str());
+		std::string line;
+		while (std::getline(results, line)) {
+			uint32_t sta;
+			std::istringstream fields(line);
+			if (!(fields >> sta) || sta >= numSTAs || sta % count != k || seen[sta]) {
+				cout << "Invalid link result in shard " << k << ": " << line << endl;
+				return 1;
+			}
+			seen[sta] = true;
+			lines[sta] = line;
+		}
+	}
+	for (uint32_t sta = 0; sta < numSTAs; sta++) {
+		if (!seen[sta]) {
+			cout << "No link result for STA " << sta << endl;
+			return 1;
+		}
+	}
+	ofstream bs, pktsi, trput, sim;
+	bs.open((shardDir + "/BPSK_BSS_ID.txt").c_str());
+	pktsi.open((shardDir + "/BPSK_PacketSizeSent.txt").c_str());
+	trput.open((shardDir + "/BPSK_Throughput_RSS_VaryPkt.txt").c_str());
+	sim.open((shardDir + "/BPSK_Simulation_Traces_VaryPkt.txt").c_str());
+	if (!bs.is_open() || !pktsi.is_open() || !trput.is_open() || !sim.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to create the merged trace files" << endl;
+		return 1;
+	}
+	std::vector<BssAccumulator> bssStats(numAPs);
+	BssAccumulator networkStats;
+	for (uint32_t sta = 0; sta < numSTAs; sta++) {
+		uint32_t s, ap;
+		int payLoadSize, mcs, chWidth, sgi;
+		double throughput;
+		std::istringstream fields(lines[sta]);
+		fields >> s >> ap >> payLoadSize >> mcs >> chWidth >> sgi >> throughput;
+		//Delay columns of runs with flow statistics, kept as written
+		std::string delayColumns;
+		std::getline(fields, delayColumns);
+		if (ap >= numAPs) {
+			cout << "Invalid AP in the link result of STA " << sta << endl;
+			return 1;
+		}
+		bs << " " << ap;
+		pktsi << " " << payLoadSize;
+		trput << " " << throughput;
+		sim << sta << "\t\t" << ap << "\t\t" << payLoadSize << " bytes\t\t" << mcs << "\t\t\t" << chWidth << " MHz\t\t\t" << sgi
+				<< "\t\t\t" << throughput << " Mbps" << delayColumns <<endl;
+		bssStats[ap].Add(throughput);
+		networkStats.Add(throughput);
+	}
+	WriteBssSummary(bssStats, networkStats, shardDir + "/BPSK_BSS_Summary.txt");
+	//Shard 0 holds the shared outputs, they are the same in every shard
+	for (uint32_t f = 0; f < sizeof(sharedOutputs) / sizeof(sharedOutputs[0]); f++) {
+		ifstream in((ShardDirectory(shardDir, 0) + "/" + sharedOutputs[f]).c_str(), ifstream::binary);
+		if (in.is_open()) {
+			ofstream out((shardDir + "/" + sharedOutputs[f]).c_str(), ofstream::binary);
+			out << in.rdbuf();
+		}
+	}
+	cout << "Merged " << count << " shards, " << numSTAs << " link results" << endl;
+	return 0;
+}
+
+//-----------------------------------Asynchronous Result Output---------------------------------------
+/*Result of one link of the per-STA loop
+ * */
+struct LinkResultRecord {
+	uint32_t sta;
+	uint32_t ap;
+	int payLoadSize;
+	int mcs;
+	int channelW;
+	int sgi;
+	double throughput;	//Mbps
+	//Sampled runs: whether the link was simulated and the confidence interval
+	bool sampled;
+	bool simulated;
+	double halfWidth;
+	//Flow statistics runs: packets and delays in s
+	bool hasDelay;
+	uint32_t txPackets;
+	uint32_t rxPackets;
+	double lossRatio;
+	double meanDelay;
+	double meanJitter;
+	double p50;
+	double p95;
+	double p99;
+};
+
+/*Writer thread for the per-link outputs of the main loop
+ * The loop pushes a record and goes on with the next link; the writer takes the
+ * queued records in one batch, formats them and appends them to files kept open
+ * for the whole loop. The queue is bounded: a full queue blocks Push until the
+ * writer catches up, so a slow disk slows the loop down instead of growing memory.
+ * Stop drains every queued record before closing the files.
+ * */
+class ResultWriter {
+public:
+	ResultWriter(uint32_t capacity);
+	~ResultWriter();
+	void Start(bool sharded);
+	void Push(const LinkResultRecord &record);
+	void Stop();
+	uint64_t GetWritten() const;
+	//Times Push found the queue full
+	uint64_t GetBlocked() const;
+private:
+	void Drain();
+	void WriteRecord(const LinkResultRecord &r);
+	uint32_t m_capacity;
+	std::deque<LinkResultRecord> m_queue;
+	std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+	std::thread m_thread;
+	bool m_running;
+	bool m_sharded;
+	uint64_t m_written;
+	uint64_t m_blocked;
+	ofstream m_bssId, m_packetSize, m_throughput, m_traces, m_sampled, m_delay, m_linkResults;
+};
+
+ResultWriter::ResultWriter(uint32_t capacity) : m_capacity(std::max(capacity, 1u)), m_running(false), m_sharded(false),
+		m_written(0), m_blocked(0) {
+}
+
+ResultWriter::~ResultWriter() {
+	Stop();
+}
+
+void ResultWriter::Start(bool sharded) {
+	m_sharded = sharded;
+	m_running = true;
+	m_thread = std::thread(&ResultWriter::Drain, this);
+}
+
+void ResultWriter::Push(const LinkResultRecord &record) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_queue.size() >= m_capacity) {
+		m_blocked++;
+		m_notFull.wait(lock, [this] { return m_queue.size() < m_capacity; });
+	}
+	m_queue.push_back(record);
+	lock.unlock();
+	m_notEmpty.notify_one();
+}
+
+void ResultWriter::Stop() {
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (!m_running) {
+			return;
+		}
+		m_running = false;
+	}
+	m_notEmpty.notify_one();
+	m_thread.join();
+}
+
+uint64_t ResultWriter::GetWritten() const {
+	return m_written;
+}
+
+uint64_t ResultWriter::GetBlocked() const {
+	return m_blocked;
+}
+
+void ResultWriter::Drain() {
+	//Files are opened on first use so that a run without sampling or flow statistics creates none of their outputs
+	std::deque<LinkResultRecord> batch;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_notEmpty.wait(lock, [this] { return !m_queue.empty() || !m_running; });
+			if (m_queue.empty() && !m_running) {
+				break;
+			}
+			batch.swap(m_queue);
+		}
+		m_notFull.notify_all();
+		for (uint32_t r = 0; r < batch.size(); r++) {
+			WriteRecord(batch[r]);
+		}
+		m_written += batch.size();
+		batch.clear();
+		cout.flush();
+	}
+	ofstream *files[] = {&m_bssId, &m_packetSize, &m_throughput, &m_traces, &m_sampled, &m_delay, &m_linkResults};
+	for (uint32_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+		if (files[f]->is_open()) {
+			files[f]->close();
+		}
+	}
+}
+
+//Opens a result file for appending, reporting once if it cannot be opened
+static bool OpenResultFile(ofstream &file, const char *fileName) {
+	if (!file.is_open() && !file.fail()) {
+		file.open(fileName, ofstream::app);
+		if (!file.is_open()) {
+			//Throw Error Exception
+			cout << "Unable to open " << fileName << " for the link results" << endl;
+		}
+	}
+	return file.is_open();
+}
+
+void ResultWriter::WriteRecord(const LinkResultRecord &r) {
+	if (OpenResultFile(m_bssId, "BPSK_BSS_ID.txt")) {
+		m_bssId << " " << r.ap;
+	}
+	if (OpenResultFile(m_packetSize, "BPSK_PacketSizeSent.txt")) {
+		m_packetSize << " " << r.payLoadSize;
+	}
+	if (r.sampled && OpenResultFile(m_sampled, "BPSK_Sampled_Estimates.txt")) {
+		m_sampled << r.sta << "\t" << r.ap << "\t" << r.simulated << "\t" << r.throughput << "\t"
+				<< r.throughput - r.halfWidth << "\t" << r.throughput + r.halfWidth << "\n";
+	}
+	//Delay columns of the traces, in ms, for links simulated in the loop
+	std::ostringstream delayColumns;
+	if (r.hasDelay) {
+		delayColumns << "\t" << r.lossRatio << "\t" << 1e3 * r.meanDelay << "\t" << 1e3 * r.meanJitter << "\t"
+				<< 1e3 * r.p50 << "\t" << 1e3 * r.p95 << "\t" << 1e3 * r.p99;
+		if (OpenResultFile(m_delay, "BPSK_Delay_Stats.txt")) {
+			m_delay << r.sta << "\t" << r.ap << "\t" << r.txPackets << "\t" << r.rxPackets << delayColumns.str() << "\n";
+		}
+	}
+	std::ostringstream line;
+	line << r.sta << "\t\t" << r.ap << "\t\t" << r.payLoadSize << " bytes\t\t" << r.mcs << "\t\t\t" << r.channelW << " MHz\t\t\t"
+			<< r.sgi << "\t\t\t" << r.throughput << " Mbps" << delayColumns.str() << "\n";
+	std::cout << line.str();
+	if (OpenResultFile(m_throughput, "BPSK_Throughput_RSS_VaryPkt.txt")) {
+		m_throughput << " " << r.throughput;
+	}
+	if (OpenResultFile(m_traces, "BPSK_Simulation_Traces_VaryPkt.txt")) {
+		m_traces << line.str();
+	}
+	if (m_sharded && OpenResultFile(m_linkResults, "LinkResults.txt")) {
+		//One self-describing line per link for the merge
+		m_linkResults.precision(17);
+		m_linkResults << r.sta << " " << r.ap << " " << r.payLoadSize << " " << r.mcs << " " << r.channelW << " " << r.sgi
+				<< " " << r.throughput << delayColumns.str() << "\n";
+	}
+}
+
+//Set by SIGINT or SIGTERM: the link loop stops after the current link and the results are drained
+volatile sig_atomic_t g_interrupted = 0;
+
+void InterruptHandler(int signum) {
+	g_interrupted = signum;
+}
+
+//-----------------------------------Parallel Stages---------------------------------------
+/*Work-stealing pool for the per-STA front-end stages (distance, RSS, association)
+ * A stage is split into ranges of rows dealt out in contiguous blocks, one queue per
+ * worker. A worker takes ranges from the front of its own queue and, once it is empty,
+ * steals from the back of the others, so uneven rows do not leave cores idle. The
+ * caller's thread works as worker 0. Rows only write their own preallocated output,
+ * the queue locks are the only synchronization.
+ * */
+class WorkStealingPool {
+public:
+	typedef std::function<void(uint32_t begin, uint32_t end)> RowsFn;
+	WorkStealingPool(uint32_t threads);
+	~WorkStealingPool();
+	//Runs body over [0, rows) in ranges of at most grain rows, 0 for an automatic grain
+	void ParallelRows(uint32_t rows, uint32_t grain, const RowsFn &body);
+	uint32_t GetThreads() const;
+private:
+	struct RangeQueue {
+		std::mutex lock;
+		std::deque<std::pair<uint32_t, uint32_t> > ranges;
+	};
+	bool Take(uint32_t worker, std::pair<uint32_t, uint32_t> &range);
+	void RunRanges(uint32_t worker);
+	void Worker(uint32_t worker);
+	std::vector<std::unique_ptr<RangeQueue> > m_queues;
+	std::vector<std::thread> m_threads;
+	const RowsFn *m_body;
+	std::atomic<uint64_t> m_pending;	//Ranges not finished yet
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint64_t m_generation;
+	bool m_stop;
+};
+
+WorkStealingPool::WorkStealingPool(uint32_t threads) : m_body(0), m_pending(0), m_generation(0), m_stop(false) {
+	threads = std::max(threads, 1u);
+	for (uint32_t w = 0; w < threads; w++) {
+		m_queues.push_back(std::unique_ptr<RangeQueue>(new RangeQueue));
+	}
+	for (uint32_t w = 1; w < threads; w++) {
+		m_threads.push_back(std::thread(&WorkStealingPool::Worker, this, w));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (uint32_t t = 0; t < m_threads.size(); t++) {
+		m_threads[t].join();
+	}
+}
+
+uint32_t WorkStealingPool::GetThreads() const {
+	return m_queues.size();
+}
+
+void WorkStealingPool::ParallelRows(uint32_t rows, uint32_t grain, const RowsFn &body) {
+	uint32_t workers = m_queues.size();
+	if (rows == 0) {
+		return;
+	}
+	if (workers == 1) {
+		body(0, rows);
+		return;
+	}
+	//About eight ranges per worker leaves enough to steal without contending on the queues
+	if (grain == 0) {
+		grain = std::max(1u, rows / (workers * 8));
+	}
+	uint32_t numRanges = (rows + grain - 1) / grain;
+	m_body = &body;
+	//Pending is set before any range is visible so that a late worker cannot underflow it
+	m_pending.store(numRanges);
+	for (uint32_t w = 0; w < workers; w++) {
+		std::lock_guard<std::mutex> guard(m_queues[w]->lock);
+		for (uint64_t r = (uint64_t) numRanges * w / workers; r < (uint64_t) numRanges * (w + 1) / workers; r++) {
+			uint32_t begin = r * grain;
+			m_queues[w]->ranges.push_back(std::make_pair(begin, std::min(rows, begin + grain)));
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_generation++;
+	}
+	m_wake.notify_all();
+	RunRanges(0);
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending.load() == 0; });
+}
+
+bool WorkStealingPool::Take(uint32_t worker, std::pair<uint32_t, uint32_t> &range) {
+	uint32_t workers = m_queues.size();
+	{
+		RangeQueue &own = *m_queues[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.ranges.empty()) {
+			range = own.ranges.front();
+			own.ranges.pop_front();
+			return true;
+		}
+	}
+	for (uint32_t v = 1; v < workers; v++) {
+		RangeQueue &victim = *m_queues[(worker + v) % workers];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.ranges.empty()) {
+			range = victim.ranges.back();
+			victim.ranges.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::RunRanges(uint32_t worker) {
+	std::pair<uint32_t, uint32_t> range;
+	//All ranges are queued before the workers wake, so empty queues mean nothing is left to take
+	while (m_pending.load() > 0 && Take(worker, range)) {
+		(*m_body)(range.first, range.second);
+		if (m_pending.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> guard(m_mutex);
+			m_done.notify_all();
+		}
+	}
+}
+
+void WorkStealingPool::Worker(uint32_t worker) {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this, seen] { return m_stop || m_generation != seen; });
+			if (m_stop) {
+				return;
+			}
+			seen = m_generation;
+		}
+		RunRanges(worker);
+	}
+}
+
+/*Row kernels of the front-end stages, each row only reads its own STA
+ * distance, RSS and serving AP are numSTAs x numAPs (serving numSTAs) arrays
+ * addressed by absolute row, so any range of rows can be computed on its own
+ * */
+void DistanceRows(uint32_t begin, uint32_t end, const std::vector<Vector> &apPos, const std::vector<Vector> &staPos,
+		double *distance){
+	for (uint32_t st = begin; st < end; st++) {
+		double *row = distance + (uint64_t) st * numAPs;
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			row[ap] = CalculateDistance(apPos[ap], staPos[st]);
+		}
+	}
+}
+
+//Both directions of a row together, with the per-pair shadowing drawn per STA when shadowingSigma > 0
+void RssRows(uint32_t begin, uint32_t end, RssMatrixFn rssKernel, double shadowingSigma, const double *distance,
+		double *rssUlDbm, double *rssDlDbm){
+	uint64_t offset = (uint64_t) begin * numAPs, count = (uint64_t) (end - begin) * numAPs;
+	//Shadowing in dB of the rows, fixed per pair and the same in both directions
+	std::vector<double> shadowDb(count, 0.0);
+	for (uint32_t st = begin; st < end && shadowingSigma > 0; st++) {
+		double *row = &shadowDb[(uint64_t) (st - begin) * numAPs];
+		CounterRng(RNG_SHADOW, st).Normal(0, numAPs, row);
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			row[ap] *= shadowingSigma;
+		}
+	}
+	rssKernel(distance + offset, &shadowDb[0], txPower_STAdBm, rssUlDbm + offset, count);
+	rssKernel(distance + offset, &shadowDb[0], txPower_APdBm, rssDlDbm + offset, count);
+}
+
+//AP with the largest RSS for every row
+void BestApRows(uint32_t begin, uint32_t end, const double *rssDbm, uint32_t *serving){
+	for (uint32_t st = begin; st < end; st++) {
+		const double *row = rssDbm + (uint64_t) st * numAPs;
+		double best = row[0];
+		uint32_t index = 0; //Stores index of max RSS
+		for (uint32_t ap = 1; ap < numAPs; ap++) {
+			if (row[ap] > best) {
+				best = row[ap];
+				index = ap;
+			}
+		}
+		serving[st] = index;
+	}
+}
+
+//-----------------------------------Conflict Graph---------------------------------------
+/*Sparse graph of the BSSs that can hear each other, in CSR form
+ * Two co-channel BSSs a and b conflict when AP a receives AP b at or above the CCA
+ * threshold, or a STA of one receives the AP of the other at or above it (down-link
+ * RSS), or an AP receives a STA of the other (up-link RSS). The neighbours of AP a are
+ * m_neighbours[m_offsets[a] .. m_offsets[a + 1] - 1], sorted. BSSs of different
+ * connected components never sense each other, so they can be simulated apart.
+ * */
+class ConflictGraph {
+public:
+	ConflictGraph();
+	//Graph of the BSSs above ccaDbm given the up-link association serving and RSS rss*Dbm[st * numAPs + ap]
+	void Build(const std::vector<Vector> &apPos, const std::vector<uint32_t> &serving, const double *rssUlDbm,
+			const double *rssDlDbm, const std::vector<uint32_t> &apChannel, RssMatrixFn rssKernel, double ccaDbm, WorkStealingPool &pool);
+	//Every co-channel pair, the implicit graph used without a CCA threshold
+	void BuildCoChannel(const std::vector<std::vector<uint32_t> > &coChannelAPs);
+	const uint32_t *Neighbours(uint32_t ap) const;
+	uint32_t Degree(uint32_t ap) const;
+	uint64_t GetEdges() const;
+	//APs of every connected component, components ordered by their smallest AP
+	std::vector<std::vector<uint32_t> > Components() const;
+	void Write(std::string fileName, const std::vector<uint32_t> &apChannel) const;
+private:
+	void FromEdges(std::vector<std::pair<uint32_t, uint32_t> > &edges);
+	std::vector<uint64_t> m_offsets;
+	std::vector<uint32_t> m_neighbours;
+};
+
+ConflictGraph::ConflictGraph() : m_offsets(1, 0) {
+}
+
+void ConflictGraph::Build(const std::vector<Vector> &apPos, const std::vector<uint32_t> &serving, const double *rssUlDbm,
+		const double *rssDlDbm, const std::vector<uint32_t> &apChannel, RssMatrixFn rssKernel, double ccaDbm, WorkStealingPool &pool){
+	std::vector<std::pair<uint32_t, uint32_t> > edges;
+	std::mutex edgesLock;
+	//AP to AP, one row at a time so that no numAPs x numAPs matrix is kept
+	pool.ParallelRows(numAPs, 0, [&](uint32_t begin, uint32_t end) {
+		std::vector<double> distance(numAPs), rss(numAPs), noShadow(numAPs, 0.0);
+		std::vector<std::pair<uint32_t, uint32_t> > local;
+		for (uint32_t a = begin; a < end; a++) {
+			for (uint32_t b = 0; b < numAPs; b++) {
+				distance[b] = CalculateDistance(apPos[a], apPos[b]);
+			}
+			rssKernel(&distance[0], &noShadow[0], txPower_APdBm, &rss[0], numAPs);
+			for (uint32_t b = a + 1; b < numAPs; b++) {
+				if (apChannel[b] == apChannel[a] && rss[b] >= ccaDbm) {
+					local.push_back(std::make_pair(a, b));
+				}
+			}
+		}
+		std::lock_guard<std::mutex> guard(edgesLock);
+		edges.insert(edges.end(), local.begin(), local.end());
+	});
+	//STA of BSS a hearing AP b at the AP power, or AP b hearing the STA at the STA power
+	pool.ParallelRows(numSTAs, 0, [&](uint32_t begin, uint32_t end) {
+		std::vector<std::pair<uint32_t, uint32_t> > local;
+		for (uint32_t st = begin; st < end; st++) {
+			uint32_t a = serving[st];
+			const double *ul = rssUlDbm + (uint64_t) st * numAPs;
+			const double *dl = rssDlDbm + (uint64_t) st * numAPs;
+			for (uint32_t b = 0; b < numAPs; b++) {
+				if (b != a && (dl[b] >= ccaDbm || ul[b] >= ccaDbm) && apChannel[b] == apChannel[a]) {
+					local.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+				}
+			}
+		}
+		std::lock_guard<std::mutex> guard(edgesLock);
+		edges.insert(edges.end(), local.begin(), local.end());
+	});
+	FromEdges(edges);
+}
+
+void ConflictGraph::BuildCoChannel(const std::vector<std::vector<uint32_t> > &coChannelAPs){
+	std::vector<std::pair<uint32_t, uint32_t> > edges;
+	for (uint32_t a = 0; a < coChannelAPs.size(); a++) {
+		for (uint32_t v = 0; v < coChannelAPs[a].size(); v++) {
+			if (a < coChannelAPs[a][v]) {
+				edges.push_back(std::make_pair(a, coChannelAPs[a][v]));
+			}
+		}
+	}
+	FromEdges(edges);
+}
+
+//Edges (a, b) with a < b, possibly repeated, into the symmetric CSR adjacency
+void ConflictGraph::FromEdges(std::vector<std::pair<uint32_t, uint32_t> > &edges){
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	m_offsets.assign(numAPs + 1, 0);
+	for (uint64_t e = 0; e < edges.size(); e++) {
+		m_offsets[edges[e].first + 1]++;
+		m_offsets[edges[e].second + 1]++;
+	}
+	for (uint32_t ap = 0; ap < numAPs; ap++) {
+		m_offsets[ap + 1] += m_offsets[ap];
+	}
+	m_neighbours.resize(m_offsets[numAPs]);
+	std::vector<uint64_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+	for (uint64_t e = 0; e < edges.size(); e++) {
+		m_neighbours[fill[edges[e].first]++] = edges[e].second;
+		m_neighbours[fill[edges[e].second]++] = edges[e].first;
+	}
+	for (uint32_t ap = 0; ap < numAPs; ap++) {
+		std::sort(m_neighbours.begin() + m_offsets[ap], m_neighbours.begin() + m_offsets[ap + 1]);
+	}
+}
+
+const uint32_t *ConflictGraph::Neighbours(uint32_t ap) const {
+	return m_neighbours.empty() ? 0 : &m_neighbours[0] + m_offsets[ap];
+}
+
+uint32_t ConflictGraph::Degree(uint32_t ap) const {
+	return m_offsets[ap + 1] - m_offsets[ap];
+}
+
+uint64_t ConflictGraph::GetEdges() const {
+	return m_neighbours.size() / 2;
+}
+
+std::vector<std::vector<uint32_t> > ConflictGraph::Components() const {
+	std::vector<std::vector<uint32_t> > components;
+	std::vector<bool> seen(numAPs, false);
+	std::vector<uint32_t> stack;
+	for (uint32_t root = 0; root < numAPs; root++) {
+		if (seen[root]) {
+			continue;
+		}
+		components.push_back(std::vector<uint32_t>());
+		seen[root] = true;
+		stack.push_back(root);
+		while (!stack.empty()) {
+			uint32_t ap = stack.back();
+			stack.pop_back();
+			components.back().push_back(ap);
+			for (uint64_t n = m_offsets[ap]; n < m_offsets[ap + 1]; n++) {
+				if (!seen[m_neighbours[n]]) {
+					seen[m_neighbours[n]] = true;
+					stack.push_back(m_neighbours[n]);
+				}
+			}
+		}
+		std::sort(components.back().begin(), components.back().end());
+	}
+	return components;
+}
+
+void ConflictGraph::Write(std::string fileName, const std::vector<uint32_t> &apChannel) const {
+	ofstream cg;
+	cg.open(fileName.c_str());
+	if (!cg.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the conflict graph in file" << endl;
+		return;
+	}
+	std::vector<std::vector<uint32_t> > components = Components();
+	std::vector<uint32_t> componentOf(numAPs);
+	for (uint32_t c = 0; c < components.size(); c++) {
+		for (uint32_t m = 0; m < components[c].size(); m++) {
+			componentOf[components[c][m]] = c;
+		}
+	}
+	cg << "#APs " << numAPs << " edges " << GetEdges() << " components " << components.size() << endl;
+	cg << "#ap\tchannel\tcomponent\tdegree\tneighbours" << endl;
+	for (uint32_t ap = 0; ap < numAPs; ap++) {
+		cg << ap << "\t" << apChannel[ap] << "\t" << componentOf[ap] << "\t" << Degree(ap) << "\t";
+		for (uint64_t n = m_offsets[ap]; n < m_offsets[ap + 1]; n++) {
+			cg << (n > m_offsets[ap] ? "," : "") << m_neighbours[n];
+		}
+		cg << "\n";
+	}
+	cg.close();
+}
+
+//-----------------------------------Association Candidates---------------------------------------
+/* The k best APs of every STA, best first, into candidates[st * k .. st * k + k - 1]
+ * The score of an AP is its RSS in rssDbm[st * numAPs + ap] minus penaltyDb[ap]: no
+ * penalty ranks by RSS, the noise plus interference of the AP in dB ranks by SINR.
+ * nth_element followed by a sort of the first k costs O(numAPs + k log k) per STA.
+ * */
+void TopKCandidates(const double *rssDbm, const std::vector<double> &penaltyDb, uint32_t k,
+		std::vector<uint32_t> &candidates){
+	k = std::min(k, numAPs);
+	candidates.resize((uint64_t) numSTAs * k);
+	std::vector<uint32_t> index(numAPs);
+	std::vector<double> score(numAPs);
+	for (uint32_t st = 0; st < numSTAs; st++) {
+		const double *row = rssDbm + (uint64_t) st * numAPs;
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			index[ap] = ap;
+			score[ap] = row[ap] - penaltyDb[ap];
+		}
+		std::vector<double> &s = score;
+		std::nth_element(index.begin(), index.begin() + (k - 1), index.end(),
+				[&s](uint32_t a, uint32_t b) { return s[a] > s[b]; });
+		std::sort(index.begin(), index.begin() + k, [&s](uint32_t a, uint32_t b) { return s[a] > s[b]; });
+		std::copy(index.begin(), index.begin() + k, candidates.begin() + (uint64_t) st * k);
+	}
+}
+
+//-----------------------------------Association Policies---------------------------------------
+/* SINR policy: every STA picks the AP with the best expected up-link SINR
+ * rssUlDbm[st * numAPs + ap] is the up-link RSS. The expected interference at an AP is
+ * the activity factor times the power of the co-channel STAs served by other APs;
+ * since that depends on the association itself, the choice is repeated from the
+ * start association until no STA moves or maxRounds is reached.
+ * */
+std::vector<uint32_t> SinrAssociation(const double *rssUlDbm, const std::vector<uint32_t> &start,
+		const std::vector<uint32_t> &apChannel, double activity, uint32_t maxRounds){
+	std::vector<uint32_t> serving(start);
+	std::vector<double> apInterferenceMw(numAPs);
+	const double noise = NoiseFloorMw(20);
+	for (uint32_t round = 0; round < maxRounds; round++) {
+		std::fill(apInterferenceMw.begin(), apInterferenceMw.end(), 0.0);
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				if (ap != serving[st] && apChannel[ap] == apChannel[serving[st]]) {
+					apInterferenceMw[ap] += activity * FastDbmToMw(rssUlDbm[(uint64_t) st * numAPs + ap]);
+				}
+			}
+		}
+		bool moved = false;
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			uint32_t best = serving[st];
+			double bestSinr = -1e300;
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				double rss = rssUlDbm[(uint64_t) st * numAPs + ap];
+				double interference = apInterferenceMw[ap];
+				//A STA does not interfere with its own link
+				if (ap != serving[st] && apChannel[ap] == apChannel[serving[st]]) {
+					interference -= activity * FastDbmToMw(rss);
+				}
+				double sinr = rss - FastMwToDb(std::max(interference, 0.0) + noise);
+				if (sinr > bestSinr) {
+					bestSinr = sinr;
+					best = ap;
+				}
+			}
+			moved = moved || best != serving[st];
+			serving[st] = best;
+		}
+		if (!moved) {
+			break;
+		}
+	}
+	return serving;
+}
+
+/* Load-aware policy: STAs in decreasing order of their best RSS pick the AP offering
+ * the largest share of the Shannon capacity, log2(1 + SNR) over the users it would serve
+ * With k > 0 a STA only weighs its k candidate APs instead of all of them.
+ * */
+std::vector<uint32_t> LoadAwareAssociation(const double *rssUlDbm, const std::vector<uint32_t> &candidates, uint32_t k){
+	const double noise = NoiseFloorMw(20);
+	std::vector<std::pair<double, uint32_t> > order(numSTAs);
+	for (uint32_t st = 0; st < numSTAs; st++) {
+		const double *row = rssUlDbm + (uint64_t) st * numAPs;
+		order[st] = std::make_pair(-*std::max_element(row, row + numAPs), st);
+	}
+	std::sort(order.begin(), order.end());
+	std::vector<uint32_t> serving(numSTAs, 0);
+	std::vector<uint32_t> users(numAPs, 0);
+	for (uint32_t o = 0; o < numSTAs; o++) {
+		uint32_t st = order[o].second;
+		double bestShare = -1;
+		for (uint32_t c = 0; c < (k > 0 ? k : numAPs); c++) {
+			uint32_t ap = k > 0 ? candidates[(uint64_t) st * k + c] : c;
+			double share = log2(1 + FastDbmToMw(rssUlDbm[(uint64_t) st * numAPs + ap]) / noise) / (users[ap] + 1);
+			if (share > bestShare) {
+				bestShare = share;
+				serving[st] = ap;
+			}
+		}
+		users[serving[st]]++;
+	}
+	return serving;
+}
+
+//-----------------------------------Benchmark Report---------------------------------------
+/*Heap matrix stored row-major in one block and indexed as m[i][j], like the
+ * arrays it replaces, so its size is not bounded by the stack
+ * */
+template <class T>
+class DenseMatrix {
+public:
+	DenseMatrix(uint32_t rows, uint32_t cols, T value = T()) : m_cols(cols), m_data((uint64_t) rows * cols, value) {}
+	T *operator[](uint32_t row) { return &m_data[(uint64_t) row * m_cols]; }
+	const T *operator[](uint32_t row) const { return &m_data[(uint64_t) row * m_cols]; }
+	uint64_t GetBytes() const { return m_data.size() * sizeof(T); }
+private:
+	uint32_t m_cols;
+	std::vector<T> m_data;
+};
+
+/*Wall time and resident memory of the phases of a run, with scalar results,
+ * written as one JSON object to compare runs between versions
+ * */
+class BenchmarkReport {
+public:
+	BenchmarkReport();
+	void StartPhase(std::string name);
+	void EndPhase();
+	void Set(std::string key, double value);
+	void SetText(std::string key, std::string value);
+	bool Write(std::string fileName) const;
+	//One "name seconds RSS delta" line per phase
+	void WritePhases(std::ostream &os) const;
+private:
+	struct Phase {
+		std::string name;
+		double seconds;
+		uint64_t rssEndBytes;
+		int64_t rssDeltaBytes;
+	};
+	std::vector<Phase> m_phases;
+	std::vector<std::pair<std::string, std::string> > m_values;
+	std::chrono::steady_clock::time_point m_start;
+	uint64_t m_startRss;
+	bool m_open;
+};
+
+BenchmarkReport::BenchmarkReport() : m_startRss(0), m_open(false) {
+}
+
+void BenchmarkReport::StartPhase(std::string name) {
+	EndPhase();
+	Phase phase = {name, 0, 0, 0};
+	m_phases.push_back(phase);
+	m_startRss = CurrentRssBytes();
+	m_start = std::chrono::steady_clock::now();
+	m_open = true;
+}
+
+void BenchmarkReport::EndPhase() {
+	if (!m_open) {
+		return;
+	}
+	Phase &phase = m_phases.back();
+	phase.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+	phase.rssEndBytes = CurrentRssBytes();
+	phase.rssDeltaBytes = (int64_t) phase.rssEndBytes - (int64_t) m_startRss;
+	m_open = false;
+}
+
+void BenchmarkReport::WritePhases(std::ostream &os) const {
+	for (uint32_t p = 0; p < m_phases.size(); p++) {
+		os << m_phases[p].name << "\t" << m_phases[p].seconds << "\t" << m_phases[p].rssEndBytes << "\t"
+				<< m_phases[p].rssDeltaBytes << endl;
+	}
 }
 
-/*Interfering RSS
- * */
-double IRssVal(Ptr<Node>Aprx, Ptr<Node>IntrSTA){
-	Ptr<LogDistancePropagationLossModel> IrssmodelIntr = CreateObject<LogDistancePropagationLossModel>();
-	//Transmit Power of STAs
-	double txPower_STAdBm = +12; //12dBm, 15.85mW
-	//Get AP location on the network area
-	Ptr<MobilityModel> apfixMobility = Aprx->GetObject<MobilityModel>();
-	//Get STA location on the network area
-	Ptr<MobilityModel> staMobility = IntrSTA->GetObject<MobilityModel>();
-	//Compute the RSS for STA to AP Links
-	double IrxPowerDbm= IrssmodelIntr->CalcRxPower(txPower_STAdBm, staMobility,
-			apfixMobility);
-	return IrxPowerDbm;
+void BenchmarkReport::Set(std::string key, double value) {
+	std::ostringstream text;
+	text.precision(12);
+	text << value;
+	m_values.push_back(std::make_pair(key, text.str()));
 }
 
-/*Function to determine locations of APs and STAs
- * And calculate distances between each AP and STA
- * */
-//---------------------Distance between STAs and APs----------------------
-double disAPSTA(Ptr<Node> apNode, Ptr<Node> staNode) {
-	Ptr<MobilityModel> apfixMobility = apNode->GetObject<MobilityModel>();
-	Ptr<MobilityModel> staMobility = staNode->GetObject<MobilityModel>();
-	double disbtwAPnSTA = staMobility->GetDistanceFrom(apfixMobility);
-	//Return distance between AP and STA
-	return disbtwAPnSTA;
+void BenchmarkReport::SetText(std::string key, std::string value) {
+	m_values.push_back(std::make_pair(key, "\"" + value + "\""));
 }
 
-/* Function to determine RSS between AP_j and STA_i  in Down-link
- * Using Log Distance Propagation Model
- * */
-//-------------------Down-link PathLoss for RSS between APs and STAs------------------------------
-double RssValueSTAAPDL(Ptr<Node> apnode, Ptr<Node> stanode) {
-	Ptr<LogDistancePropagationLossModel> rssmodel = CreateObject<LogDistancePropagationLossModel>();
-	//Transmit Power of APs
-	double txPower_APdBm = +20.0; // 20dBm, 100mW
-	//Get AP location on the network area
-	Ptr<MobilityModel> apfixMobility = apnode->GetObject<MobilityModel>();
-	//Get STA location on the network area
-	Ptr<MobilityModel> staMobility = stanode->GetObject<MobilityModel>();
-	//Compute the RSS for AP to STA Links
-	double rxPowerDbm_DL = rssmodel->CalcRxPower(txPower_APdBm, apfixMobility, staMobility);
-	return rxPowerDbm_DL;
+bool BenchmarkReport::Write(std::string fileName) const {
+	ofstream js;
+	js.open(fileName.c_str());
+	if (!js.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the benchmark report in file" << endl;
+		return false;
+	}
+	js << "{" << endl;
+	for (uint32_t v = 0; v < m_values.size(); v++) {
+		js << "  \"" << m_values[v].first << "\": " << m_values[v].second << "," << endl;
+	}
+	js << "  \"peakRssBytes\": " << PeakRssBytes() << "," << endl;
+	js << "  \"phases\": [";
+	for (uint32_t p = 0; p < m_phases.size(); p++) {
+		js << (p ? "," : "") << endl << "    {\"name\": \"" << m_phases[p].name << "\", \"seconds\": " << m_phases[p].seconds
+				<< ", \"rssBytes\": " << m_phases[p].rssEndBytes << ", \"rssDeltaBytes\": " << m_phases[p].rssDeltaBytes << "}";
+	}
+	js << endl << "  ]" << endl << "}" << endl;
+	js.close();
+	return true;
 }
 
-/* Function to determine RSS between AP_j and STA_i  in Up-link
- * Using Log Distance Propagation Model
- * */
-//-------------------Up-link PathLoss for RSS between APs and STAs--------------------------------
-double RssValueSTAAPUL(Ptr<Node> apnode, Ptr<Node> stanode) {
-
-	Ptr<LogDistancePropagationLossModel> rssmodel1 = CreateObject<
-			LogDistancePropagationLossModel>();
-	//Transmit Power of STAs
-	double txPower_STAdBm = +12; //12dBm, 15.85mW
-	//Get AP location on the network area
-	Ptr<MobilityModel> apfixMobility = apnode->GetObject<MobilityModel>();
-	//Get STA location on the network area
-	Ptr<MobilityModel> staMobility = stanode->GetObject<MobilityModel>();
-	//Compute the RSS for STA to AP Links
-	double rxPowerDbm_UL = rssmodel1->CalcRxPower(txPower_STAdBm, staMobility,
-			apfixMobility);
-	return rxPowerDbm_UL;
+void MemoryAccounting::Write(std::string fileName, const BenchmarkReport &report) const {
+	ofstream mr;
+	mr.open(fileName.c_str());
+	if (!mr.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the memory report in file" << endl;
+		return;
+	}
+	mr << "peak RSS " << PeakRssBytes() << " bytes" << endl;
+	mr << "phase\tseconds\tRSS\tdelta" << endl;
+	report.WritePhases(mr);
+	for (uint32_t c = 0; c < m_counts.size(); c++) {
+		mr << "objects " << m_counts[c].first << endl;
+		for (Counts::const_iterator it = m_counts[c].second.begin(); it != m_counts[c].second.end(); it++) {
+			mr << "\t" << it->first << "\t" << it->second << endl;
+		}
+	}
+	if (!m_linkRss.empty()) {
+		mr << "links " << m_linkRss.size() << ", RSS " << m_linkRss.front() << " to " << m_linkRss.back()
+				<< " bytes, growth " << GetGrowthPerLink() << " bytes/link" << endl;
+	}
+	mr << "objects surviving Destroy" << endl;
+	for (Counts::const_iterator it = m_survivors.begin(); it != m_survivors.end(); it++) {
+		mr << "\t" << it->first << "\t" << it->second << endl;
+	}
+	mr << (IsLeaking() ? "LEAK suspected" : "no leak detected") << endl;
+	mr.close();
 }
 
-/*Generate Random packet sizes
- * min packet size = 500 bytes and max packaet size = 1500
+//-----------------------------------Density Sweep---------------------------------------
+/*Levels of a density sweep from "start:stop:step", stop included
  * */
-int payLoadSizeGenerator(int minPktSize, int maxPktSize){
-	//srand(time(0));
-	//return (rand() % (maxPktSize - minPktSize + 1) + minPktSize);
-	Ptr<UniformRandomVariable> ra = CreateObject<UniformRandomVariable>();
-	return ra->GetInteger(minPktSize, maxPktSize);
+bool ParseSweep(std::string spec, std::vector<uint32_t> &levels){
+	uint32_t start = 0, stop = 0, step = 0;
+	if (sscanf(spec.c_str(), "%u:%u:%u", &start, &stop, &step) != 3 || start == 0 || step == 0 || stop < start) {
+		return false;
+	}
+	levels.clear();
+	for (uint32_t n = start; n < stop; n += step) {
+		levels.push_back(n);
+	}
+	levels.push_back(stop);
+	return true;
 }
 
+/*Density sweep: the STA population grows level by level on the same APs
+ * STA positions are drawn in order from one allocator stream and shadowing per STA
+ * from RNG_SHADOW, so every level is a prefix of the next one. A level only builds
+ * the distance and RSS rows of its new STAs, associates them by RSS and adds their
+ * expected interference (activity times their power at the co-channel APs) and RSS
+ * to per-AP sums; the level metrics then come from the numAPs sums. The whole sweep
+ * costs about as much as the largest level alone.
+ * Output, one file tagged by level: a "density" line per level and an "ap" line per
+ * AP and level with its users, mean up-link SINR and expected interference.
+ * */
+void RunDensitySweep(const std::vector<uint32_t> &levels, const std::vector<Vector> &apPos, const std::vector<Vector> &staPos,
+		const std::vector<std::vector<uint32_t> > &coChannelAPs, RssMatrixFn rssKernel, double shadowingSigma,
+		double activity, WorkStealingPool &pool, double *distance, double *rssUlDbm, double *rssDlDbm,
+		std::vector<uint32_t> &serving, std::string fileName){
+	ofstream ds;
+	ds.open(fileName.c_str());
+	if (!ds.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store the density sweep in file" << endl;
+		return;
+	}
+	ds << "#density\tnumSTAs\tnewSTAs\tmeanSinrDb\tworstApSinrDb\tmaxUsersPerAp\tloadFairness\tlevelMs" << endl;
+	ds << "#ap\tnumSTAs\tap\tusers\tmeanSinrDb\tinterferenceDbm" << endl;
+	const double noise = NoiseFloorMw(20);
+	std::vector<uint32_t> users(numAPs, 0);
+	std::vector<double> apInterferenceMw(numAPs, 0.0);
+	std::vector<double> servingRssDbSum(numAPs, 0.0);
+	uint32_t built = 0;
+	for (uint32_t l = 0; l < levels.size(); l++) {
+		uint32_t n = levels[l];
+		std::chrono::steady_clock::time_point levelStart = std::chrono::steady_clock::now();
+		if (n > built) {
+			pool.ParallelRows(n - built, 0, [&](uint32_t begin, uint32_t end) {
+				DistanceRows(built + begin, built + end, apPos, staPos, distance);
+				RssRows(built + begin, built + end, rssKernel, shadowingSigma, distance, rssUlDbm, rssDlDbm);
+				BestApRows(built + begin, built + end, rssUlDbm, &serving[0]);
+			});
+			//New STAs join their BSS and interfere with the co-channel BSSs
+			for (uint32_t st = built; st < n; st++) {
+				uint32_t ap = serving[st];
+				users[ap]++;
+				servingRssDbSum[ap] += rssUlDbm[(uint64_t) st * numAPs + ap];
+				const std::vector<uint32_t> &victims = coChannelAPs[ap];
+				for (uint32_t v = 0; v < victims.size(); v++) {
+					apInterferenceMw[victims[v]] += activity * FastDbmToMw(rssUlDbm[(uint64_t) st * numAPs + victims[v]]);
+				}
+			}
+			built = n;
+		}
+		//Level metrics from the per-AP sums: the SINR of a STA is its RSS over the noise and interference of its AP
+		double sinrSum = 0, worstApSinr = 1e300, load = 0, loadSquares = 0;
+		uint32_t maxUsers = 0, servingAPs = 0;
+		std::vector<double> apSinr(numAPs, 0.0);
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			load += users[ap];
+			loadSquares += (double) users[ap] * users[ap];
+			maxUsers = std::max(maxUsers, users[ap]);
+			if (users[ap] == 0) {
+				continue;
+			}
+			double sinrApSum = servingRssDbSum[ap] - users[ap] * FastMwToDb(noise + apInterferenceMw[ap]);
+			apSinr[ap] = sinrApSum / users[ap];
+			sinrSum += sinrApSum;
+			worstApSinr = std::min(worstApSinr, apSinr[ap]);
+			servingAPs++;
+		}
+		double levelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - levelStart).count();
+		double fairness = loadSquares > 0 ? load * load / (numAPs * loadSquares) : 0;
+		ds << "density\t" << n << "\t" << n - (l > 0 ? levels[l - 1] : 0) << "\t" << sinrSum / n << "\t"
+				<< (servingAPs > 0 ? worstApSinr : 0) << "\t" << maxUsers << "\t" << fairness << "\t" << levelMs << "\n";
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			ds << "ap\t" << n << "\t" << ap << "\t" << users[ap] << "\t" << apSinr[ap] << "\t"
+					<< 10 * log10(std::max(apInterferenceMw[ap], 1e-30)) << "\n";
+		}
+		cout << "Density " << n << " STAs: mean up-link SINR " << sinrSum / n << " dB, at most " << maxUsers
+				<< " users per AP, " << levelMs << " ms" << endl;
+	}
+	ds.close();
+}
 
-//Number of Access Points
-uint32_t numAPs = 15;
-//Number of Stations
-uint32_t numSTAs = 300;
-//Association variable x_ij = 1 if STA_i associates with STA_j, x_ij = 0 otherwise
-int x_ij = 0; //Binary variable indicating association
+/*Density benchmark scenarios: STA count by name, with one AP per 20 STAs as in the
+ * 300 STA, 15 AP deployment, all in the same 300 m x 300 m area
+ * */
+bool BenchmarkScenario(std::string name, uint32_t &nSTAs, uint32_t &nAPs){
+	static const char *names[] = {"300", "3k", "30k", "300k"};
+	static const uint32_t stations[] = {300, 3000, 30000, 300000};
+	for (uint32_t s = 0; s < sizeof(stations) / sizeof(stations[0]); s++) {
+		if (name == names[s]) {
+			nSTAs = stations[s];
+			nAPs = stations[s] / 20;
+			return true;
+		}
+	}
+	return false;
+}
 
 int main (int argc, char *argv[])
 {
 
-	//Association matrix for Down-link
-	int Xij_UL[numSTAs][numAPs]; //Contains all x_ijs
-	//Association matrix for Down-link
-	int Xij_DL[numSTAs][numAPs];	//Contains all x_ijs
-	//Array of Distances between APs and STAs
-	double STA2AP_dis[numSTAs][numAPs];
-	//Array of RSS
-	double RSS_ULdBm[numSTAs][numAPs];	//Up-link
-	double RSS_DLdBm[numSTAs][numAPs];	//Down-link
 	//Simulation Time (s)
 	double simulationTime = 5; //seconds
+	//Skip beaconing, association, ARP and global routing in the link simulations
+	bool fastStart = false;
+	//Path loss model of the RSS matrices
+	std::string propagationModel = "logdistance";
+	double shadowingSigma = 8.0; //dB
+	//Small-scale fading of the interference snapshots: none, rayleigh or rician
+	std::string fadingModel = "none";
+	double ricianKdB = 6.0;
+	//Assign non-overlapping channels to the APs, otherwise all share one channel
+	bool channelPlanning = true;
+	//Interference snapshots of the Monte Carlo up-link SINR study
+	uint32_t numSnapshots = 100;
+	//Binary per-packet trace of the link simulations, empty to disable
+	std::string packetTrace = "";
+	uint32_t packetTraceCapacity = 1 << 20; //records
+	//Density sweep "start:stop:step" in STAs on the same APs, empty to disable, and the activity of its interferers
+	std::string densitySweep = "";
+	double sweepActivity = 0.5;
+	//Sparse BSS conflict graph at the CCA threshold for interference and contention groups
+	bool useConflictGraph = false;
+	double ccaThreshold = -82.0; //dBm
+	//SINR to PER lookup table written by wifi_interference --perTable, and its mode used for the up-link
+	std::string perTableFile = "";
+	std::string perModeName = "HtMcs0";
+	//Link results queued for the writer thread before the loop waits for it
+	uint32_t resultQueue = 4096;
+	//Sharded execution: one shard "i/n", a job queue worker over n shards or a merge of n shards
+	std::string shardArg = "";
+	uint32_t workerShards = 0;
+	double jobLease = 300; //s without renewal before a job lock is taken over
+	uint32_t mergeShards = 0;
+	std::string shardDir = ".";
+	//Comparative mode: association policies evaluated on the same topology, empty to disable
+	std::string policies = "";
+	//Per-BSS contention simulations in parallel worker processes
+	bool bssContention = false;
+	uint32_t bssWorkers = std::max (std::thread::hardware_concurrency (), 1u);
+	//Density benchmark: scenario name, JSON report and memory budget (MB, 0 for none)
+	std::string benchmark = "";
+	std::string benchmarkJson = "";
+	double memoryBudget = 0;
+	//Print and store every STA-AP pair of the distance and RSS matrices, print every STA of the association and SINR
+	bool verbose = true;
+	//Threads of the distance, RSS and association stages
+	uint32_t threads = std::max (std::thread::hardware_concurrency (), 1u);
+	//Candidate APs kept per STA, 0 for none, ranked by "rss" or "sinr"
+	uint32_t topK = 0;
+	std::string topKMetric = "rss";
+	//Stratified sampling of the link simulations: STAs simulated per stratum, 0 simulates all
+	uint32_t samplePerStratum = 0;
+	double distanceBand = 10; //meters
+	int payloadBucket = 100; //bytes
+	//Attribute the wall time of the link simulations to event types
+	bool profileEvents = false;
+	//Loss, delay, jitter and delay percentiles of every link
+	bool flowStats = false;
+	//Run directory keeping stage outputs and link results by input hash, empty to disable
+	std::string runDir = "";
 	//Distance between STA and AP
 	double distance = 0.0; //meters
 	//Frequency
 	double freqBand = 2.4; //whether 2.4 or 5.0 GHz
+	//Command Line Paramters
+	  CommandLine cmd;
+	  //Set IEEE 802.11 Network Frequency
+	  cmd.AddValue ("frequency", "IEEE 802.11n supports both 5GHz or 2.4GHz", freqBand);
+	  //Run simulation for different simulation time
+	  cmd.AddValue ("simulationTime", "Simulation time in seconds", simulationTime);
+	  //Pre-associated links with seeded ARP caches and static routes
+	  cmd.AddValue ("fastStart", "Pre-associate STAs, seed ARP and use static routes so measurement starts at t=0", fastStart);
+	  cmd.AddValue ("propagation", "RSS path loss model: logdistance, logdistance-shadowing or tworay", propagationModel);
+	  cmd.AddValue ("shadowingSigma", "Standard deviation of log-normal shadowing in dB", shadowingSigma);
+	  cmd.AddValue ("fading", "Per-snapshot fading of the SINR snapshots: none, rayleigh or rician", fadingModel);
+	  cmd.AddValue ("ricianK", "K factor of Rician fading in dB", ricianKdB);
+	  cmd.AddValue ("channelPlanning", "Assign non-overlapping channels to the APs from their mutual RSS", channelPlanning);
+	  cmd.AddValue ("numSnapshots", "Random sets of active STAs averaged in the up-link SINR study", numSnapshots);
+	  cmd.AddValue ("packetTrace", "Binary file for per-packet PHY and UDP receive events of the link simulations", packetTrace);
+	  cmd.AddValue ("packetTraceCapacity", "Records held by the trace ring buffer", packetTraceCapacity);
+	  cmd.AddValue ("densitySweep", "Grow the STAs start:stop:step on the same APs, computing only the new rows per level", densitySweep);
+	  cmd.AddValue ("sweepActivity", "Activity factor of the interfering STAs in the density sweep", sweepActivity);
+	  cmd.AddValue ("conflictGraph", "Only BSSs that hear each other above the CCA threshold interfere and contend together", useConflictGraph);
+	  cmd.AddValue ("ccaThreshold", "Carrier sense threshold of the conflict graph in dBm", ccaThreshold);
+	  cmd.AddValue ("perTable", "SINR to PER table giving the packet error rate of every SINR snapshot", perTableFile);
+	  cmd.AddValue ("perMode", "Wifi mode of the PER table used for the up-link", perModeName);
+	  cmd.AddValue ("resultQueue", "Link results queued for the writer thread before the loop waits", resultQueue);
+	  cmd.AddValue ("shard", "Run only shard i/n of the STAs, writing to shardDir/shard_i", shardArg);
+	  cmd.AddValue ("worker", "Pull shards of an n-shard job queue in shardDir until all are complete", workerShards);
+	  cmd.AddValue ("jobLease", "Seconds a job lock stays valid without renewal by its worker", jobLease);
+	  cmd.AddValue ("merge", "Merge the results of n shards in shardDir into the canonical traces", mergeShards);
+	  cmd.AddValue ("shardDir", "Directory shared by the shards, the job queue and the merged traces", shardDir);
+	  cmd.AddValue ("policies", "Compare association policies on one topology: comma separated maxrss, sinr and load", policies);
+	  cmd.AddValue ("bssContention", "Simulate every BSS with all its STAs contending instead of one link per STA", bssContention);
+	  cmd.AddValue ("bssWorkers", "BSS simulations running in parallel processes", bssWorkers);
+	  cmd.AddValue ("numSTAs", "Number of STAs", numSTAs);
+	  cmd.AddValue ("numAPs", "Number of APs", numAPs);
+	  cmd.AddValue ("benchmark", "Density benchmark scenario 300, 3k, 30k or 300k STAs; skips the link simulations", benchmark);
+	  cmd.AddValue ("benchmarkJson", "JSON file for phase timings and memory, defaults to Benchmark_<scenario>.json", benchmarkJson);
+	  cmd.AddValue ("memoryBudget", "Refuse to allocate the matrices beyond this many MB, 0 for no limit (80% of RAM for benchmarks)", memoryBudget);
+	  cmd.AddValue ("verbose", "Print and store every STA-AP pair of the distance and RSS matrices", verbose);
+	  cmd.AddValue ("samplePerStratum", "Simulate this many STAs per distance band and payload bucket and estimate the rest, 0 for all", samplePerStratum);
+	  cmd.AddValue ("distanceBand", "Width of the distance bands of the sampling strata in meters", distanceBand);
+	  cmd.AddValue ("payloadBucket", "Width of the payload buckets of the sampling strata in bytes", payloadBucket);
+	  cmd.AddValue ("profileEvents", "Time every simulator event by handler type; writes EventProfile.txt and EventProfile.folded", profileEvents);
+	  cmd.AddValue ("flowStats", "Collect loss, delay, jitter and p50/p95/p99 delay of every link next to its throughput", flowStats);
+	  cmd.AddValue ("runDir", "Reuse the stages and links of earlier runs whose inputs are unchanged, kept in this directory", runDir);
+	  cmd.AddValue ("threads", "Threads for the distance, RSS and association stages", threads);
+	  cmd.AddValue ("topK", "Keep the K best candidate APs of every STA; the load-aware policy then only weighs those", topK);
+	  cmd.AddValue ("topKMetric", "Rank the candidate APs by rss or by expected sinr", topKMetric);
+	  cmd.Parse (argc,argv);
+	CounterRng::SetRunKey ();
+
+	PerTable perTable;
+	int32_t perMode = -1;
+	if (!perTableFile.empty ()) {
+		if (!perTable.Load (perTableFile)) {
+			cout << "Unable to read the PER table " << perTableFile << endl;
+			return 1;
+		}
+		perMode = perTable.GetModeIndex (perModeName);
+		if (perMode < 0) {
+			cout << "The PER table " << perTableFile << " has no mode " << perModeName << endl;
+			return 1;
+		}
+	}
+
+	FadingModel fading = NO_FADING;
+	if (fadingModel == "rayleigh") {
+		fading = RAYLEIGH_FADING;
+	} else if (fadingModel == "rician") {
+		fading = RICIAN_FADING;
+	} else if (fadingModel != "none") {
+		cout << "Unknown fading model " << fadingModel << ", expected none, rayleigh or rician" << endl;
+		return 1;
+	}
+	double ricianK = pow(10, ricianKdB / 10);
+
+	if (profileEvents) {
+		//Must be bound before the first simulator call, which creates the implementation
+		GlobalValue::Bind ("SimulatorImplementationType", StringValue ("ns3::ProfilingSimulatorImpl"));
+	}
+
+	if (!benchmark.empty ()) {
+		if (!BenchmarkScenario (benchmark, numSTAs, numAPs)) {
+			cout << "Unknown benchmark scenario " << benchmark << ", expected 300, 3k, 30k or 300k" << endl;
+			return 1;
+		}
+		verbose = false;
+		if (benchmarkJson.empty ()) {
+			benchmarkJson = "Benchmark_" + benchmark + ".json";
+		}
+	}
+	std::vector<uint32_t> sweepLevels;
+	if (!densitySweep.empty ()) {
+		if (!ParseSweep (densitySweep, sweepLevels)) {
+			cout << "Invalid density sweep " << densitySweep << ", expected start:stop:step" << endl;
+			return 1;
+		}
+		//Positions and matrix rows for the largest level, filled level by level
+		numSTAs = sweepLevels.back ();
+		verbose = false;
+	}
+	BenchmarkReport report;
+	report.SetText ("scenario", benchmark.empty () ? "custom" : benchmark);
+	report.Set ("numSTAs", numSTAs);
+	report.Set ("numAPs", numAPs);
+	//Three STA x AP matrices, the associations and candidates, the serving AP and throughput
+	//of every compared policy and the AP x AP planning arrays
+	uint32_t numPolicies = policies.empty () ? 0 : 1 + std::count (policies.begin (), policies.end (), ',');
+	uint64_t matrixBytes = (uint64_t) numSTAs * numAPs * 3 * sizeof(double) + (uint64_t) numSTAs * (2 + topK) * sizeof(uint32_t)
+			+ (uint64_t) numSTAs * numPolicies * (sizeof(uint32_t) + sizeof(double))
+			+ (channelPlanning ? (uint64_t) numAPs * numAPs * 4 * sizeof(double) : 0);
+	report.Set ("matrixBytes", matrixBytes);
+	report.Set ("matrixBytesPerSta", (double) matrixBytes / numSTAs);
+	if (!benchmark.empty () && memoryBudget == 0) {
+		//Benchmarks default to 80% of the physical memory, so a scenario too large for the host reports it instead of dying
+		memoryBudget = 0.8 * sysconf (_SC_PHYS_PAGES) * (double) sysconf (_SC_PAGE_SIZE) / (1024 * 1024);
+	}
+	report.Set ("memoryBudgetMB", memoryBudget);
+	if (memoryBudget > 0 && matrixBytes > memoryBudget * 1024 * 1024) {
+		cout << "The matrices need " << matrixBytes / (1024 * 1024) << " MB, over the budget of " << memoryBudget << " MB" << endl;
+		report.SetText ("status", "over memory budget");
+		if (!benchmarkJson.empty ()) {
+			report.Write (benchmarkJson);
+		}
+		return 1;
+	}
+
+	//The whole STA set unless a shard is selected
+	ShardSpec shard = {0, 1};
+	if (mergeShards > 0) {
+		return MergeShards (shardDir, mergeShards);
+	}
+	//Only the per-link results of LinkResults.txt are merged, a policy comparison would stay split by shard
+	if (!policies.empty () && (workerShards > 0 || !shardArg.empty ())) {
+		cout << "The policy comparison cannot be sharded, run it without shard or worker" << endl;
+		return 1;
+	}
+	if (bssContention && (workerShards > 0 || !shardArg.empty ())) {
+		cout << "The BSS contention simulations cannot be sharded, run them without shard or worker" << endl;
+		return 1;
+	}
+	//A shard enters its own directory below, the run directory stays the one given
+	if (!runDir.empty () && runDir[0] != '/') {
+		char cwd[PATH_MAX];
+		if (getcwd (cwd, sizeof(cwd)) == 0) {
+			cout << "Unable to resolve the run directory " << runDir << endl;
+			return 1;
+		}
+		runDir = std::string (cwd) + "/" + runDir;
+	}
+	if (workerShards > 0) {
+		if (!RunJobQueue (shardDir, workerShards, shard, jobLease)) {
+			return 0;
+		}
+	} else if (!shardArg.empty () && !ParseShard (shardArg, shard)) {
+		cout << "Invalid shard " << shardArg << ", expected i/n" << endl;
+		return 1;
+	}
+	bool sharded = workerShards > 0 || !shardArg.empty ();
+	if (sharded) {
+		//Every output of the shard, including the relative packet trace path, goes to its directory
+		std::string dir = ShardDirectory (shardDir, shard.index);
+		mkdir (shardDir.c_str (), 0755);
+		mkdir (dir.c_str (), 0755);
+		if (chdir (dir.c_str ()) != 0) {
+			cout << "Unable to enter the shard directory " << dir << endl;
+			return 1;
+		}
+		//Outputs are appended to, start from a clean shard when it is retried
+		for (uint32_t f = 0; f < sizeof(sharedOutputs) / sizeof(sharedOutputs[0]); f++) {
+			remove (sharedOutputs[f]);
+		}
+		remove ("BPSK_BSS_ID.txt");
+		remove ("BPSK_PacketSizeSent.txt");
+		remove ("BPSK_Throughput_RSS_VaryPkt.txt");
+		remove ("BPSK_Simulation_Traces_VaryPkt.txt");
+		remove ("LinkResults.txt");
+		remove ("ShardComplete.txt");
+	}
+
+	//Up-link association: index j of the AP with x_ij = 1 for every STA_i
+	std::vector<uint32_t> assocUL(numSTAs, 0);
+	//Down-link association
+	std::vector<uint32_t> assocDL(numSTAs, 0);
+	//Array of Distances between APs and STAs
+	DenseMatrix<double> STA2AP_dis(numSTAs, numAPs);
+	//Array of RSS
+	DenseMatrix<double> RSS_ULdBm(numSTAs, numAPs);	//Up-link
+	DenseMatrix<double> RSS_DLdBm(numSTAs, numAPs);	//Down-link
 	//Number of STAs per BSS
 	std::vector<int> totalUser(numAPs);
 	//Initialize to zero
 	std::fill(totalUser.begin(), totalUser.end(), 0);
+	//Throughput statistics of each BSS and of the whole network
+	std::vector<BssAccumulator> bssStats(numAPs);
+	BssAccumulator networkStats;
 	//Keep Record of packet sent by STAs
 	std::vector<int>packetSizes(numSTAs);
 	//Initialize to zeros
 	std::fill(packetSizes.begin(), packetSizes.end(), 0);
+
+	//Stages whose input hash is found in the run directory are loaded instead of computed
+	StageCache cache (runDir);
+	LinkStats linkStats;
+	if (flowStats) {
+		g_linkStats = &linkStats;
+	}
+
+	//Set up before the node baseline, the trace ring is not part of the ns-3 memory per STA
+	PacketTraceWriter packetTraceWriter (packetTraceCapacity);
+	if (!packetTrace.empty ()) {
+		if (!packetTraceWriter.Start (packetTrace)) {
+			cout << "Unable to open the packet trace file" << endl;
+			return 1;
+		}
+		g_packetTrace = &packetTraceWriter;
+	}
+
+	report.StartPhase ("nodes");
+	uint64_t rssBeforeNodes = CurrentRssBytes ();
 	//Stations
 	NodeContainer wifiStaNode;
 	wifiStaNode.Create(numSTAs);
 	//APs
 	NodeContainer wifiApNode;
 	wifiApNode.Create(numAPs);
-	//Command Line Paramters
-	  CommandLine cmd;
-	  //Set IEEE 802.11 Network Frequency
-	  cmd.AddValue ("frequency", "IEEE 802.11n supports both 5GHz or 2.4GHz", freqBand);
-	  //Run simulation for different simulation time
-	  cmd.AddValue ("simulationTime", "Simulation time in seconds", simulationTime);
-	  cmd.Parse (argc,argv);
 
 	//-----------------------------------------Mobility------------------------------------------------------.
 	MobilityHelper apfixMobility, staMobility;
 
 	//-----------Mobility and Locations for APs
-	apfixMobility.SetPositionAllocator("ns3::RandomRectanglePositionAllocator",
-			"X", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"),
-			"Y", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	Ptr<RandomRectanglePositionAllocator> apAlloc = CreateObject<RandomRectanglePositionAllocator>();
+	apAlloc->SetAttribute("X", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	apAlloc->SetAttribute("Y", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	apAlloc->AssignStreams(g_rng.GetStream(RNG_TOPOLOGY, 0));
+	apfixMobility.SetPositionAllocator(apAlloc);
 	apfixMobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
 	//Install Mobility on APs
 	apfixMobility.Install(wifiApNode);
 
 	//-------------Mobility and Locations for STAs----------------------------------------------------------
-	staMobility.SetPositionAllocator("ns3::RandomRectanglePositionAllocator",
-			"X", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"),
-			"Y", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	Ptr<RandomRectanglePositionAllocator> staAlloc = CreateObject<RandomRectanglePositionAllocator>();
+	staAlloc->SetAttribute("X", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	staAlloc->SetAttribute("Y", StringValue("ns3::UniformRandomVariable[Min=0.0|Max=300.0]"));
+	staAlloc->AssignStreams(g_rng.GetStream(RNG_TOPOLOGY, 1));
+	staMobility.SetPositionAllocator(staAlloc);
 	staMobility.SetMobilityModel("ns3::RandomWalk2dMobilityModel", "Mode",
 			StringValue("Time"), "Time", StringValue("5s"), "Bounds",
 			RectangleValue(Rectangle(0, 300, 0, 300)));
 	//Install Mobility on STAs
 	staMobility.Install(wifiStaNode);
+	for (uint32_t st = 0; st < numSTAs; st++) {
+		wifiStaNode.Get(st)->GetObject<MobilityModel>()->AssignStreams(g_rng.GetStream(RNG_STA, st, 1));
+	}
+	report.Set ("ns3BytesPerSta", (double) ((int64_t) CurrentRssBytes () - (int64_t) rssBeforeNodes) / numSTAs);
+	g_memory.CountObjects ("topology");
+	//Positions read once from the mobility models, the parallel stages never touch ns-3 objects
+	std::vector<Vector> apPos(numAPs), staPos(numSTAs);
+	for (uint32_t ap = 0; ap < numAPs; ap++) {
+		apPos[ap] = wifiApNode.Get(ap)->GetObject<MobilityModel>()->GetPosition();
+	}
+	for (uint32_t st = 0; st < numSTAs; st++) {
+		staPos[st] = wifiStaNode.Get(st)->GetObject<MobilityModel>()->GetPosition();
+	}
+	WorkStealingPool pool (threads);
+	report.Set ("threads", pool.GetThreads ());
+	//The topology is rebuilt every run, it is cheap and fixed by the streams; its hash roots the later stages
+	StageHash topologyHash;
+	topologyHash.Add(std::string("topology-v1")).Add((uint64_t) RngSeedManager::GetSeed()).Add((uint64_t) RngSeedManager::GetRun())
+			.Add((uint64_t) numSTAs).Add((uint64_t) numAPs);
+	cache.Note("topology", topologyHash, false);
+
+	//--------------------------------------Channel Planning-----------------------------------
+	report.StartPhase ("channelPlan");
+	std::vector<uint32_t> channels = AvailableChannels(freqBand);
+	//Channel number of every AP
+	std::vector<uint32_t> apChannel(numAPs, channels[0]);
+	StageHash channelHash = topologyHash;
+	channelHash.Add(std::string("channels")).Add(propagationModel).Add(freqBand);
+	if (channelPlanning) {
+		bool channelsCached = cache.Load("channels", channelHash, &apChannel[0], numAPs * sizeof(uint32_t));
+		cache.Note("channels", channelHash, channelsCached);
+		if (!channelsCached) {
+			//Conflict graph weighted by the AP to AP RSS
+			std::vector<double> apDistance(numAPs * numAPs), apRssDbm(numAPs * numAPs), noShadow(numAPs * numAPs, 0.0);
+			for (uint32_t a = 0; a < numAPs; a++) {
+				for (uint32_t b = 0; b < numAPs; b++) {
+					apDistance[a * numAPs + b] = CalculateDistance(apPos[a], apPos[b]);
+				}
+			}
+			SelectRssKernel(propagationModel, freqBand)(&apDistance[0], &noShadow[0], txPower_APdBm, &apRssDbm[0], numAPs * numAPs);
+			std::vector<double> conflictMw(numAPs * numAPs, 0.0);
+			for (uint32_t n = 0; n < numAPs * numAPs; n++) {
+				conflictMw[n] = (n / numAPs == n % numAPs) ? 0 : pow(10, apRssDbm[n] / 10);
+			}
+			std::vector<uint32_t> plan = PlanChannels(conflictMw, numAPs, channels.size(), 100);
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				apChannel[ap] = channels[plan[ap]];
+			}
+			cache.Store("channels", channelHash, &apChannel[0], numAPs * sizeof(uint32_t));
+		}
+		cout << "------AP Channel Plan-----------------" << endl;
+		ofstream cp;
+		cp.open("APChannelPlan.txt", ofstream::app);
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			cout << "AP " << ap << " uses channel " << apChannel[ap] << endl;
+			if (cp.is_open()) {
+				cp << " " << apChannel[ap];
+			}
+		}
+		if (cp.is_open()) {
+			cp.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store the channel plan in file";
+		}
+	}
+	//APs sharing the channel of each AP, the only ones that interfere with its BSS
+	std::vector<std::vector<uint32_t> > coChannelAPs(numAPs);
+	for (uint32_t a = 0; a < numAPs; a++) {
+		for (uint32_t b = 0; b < numAPs; b++) {
+			if (b != a && apChannel[b] == apChannel[a]) {
+				coChannelAPs[a].push_back(b);
+			}
+		}
+	}
+
+	if (!sweepLevels.empty ()) {
+		report.StartPhase ("sweep");
+		if (propagationModel == "logdistance-shadowing") {
+			g_rng.NoteRange(RNG_SHADOW, 0, numSTAs - 1);
+		}
+		RunDensitySweep(sweepLevels, apPos, staPos, coChannelAPs, SelectRssKernel(propagationModel, freqBand),
+				propagationModel == "logdistance-shadowing" ? shadowingSigma : 0, sweepActivity, pool,
+				&STA2AP_dis[0][0], &RSS_ULdBm[0][0], &RSS_DLdBm[0][0], assocUL, "DensitySweep.txt");
+		report.EndPhase ();
+		g_rng.WriteAssignments ("RngStreams.txt");
+		if (!benchmarkJson.empty ()) {
+			report.SetText ("status", "ok");
+			report.Write (benchmarkJson);
+		}
+		return 0;
+	}
 
 
 	//--------------------------------------Distance between STAs and APs-----------------------------------
-	for (int k = 0; k < numSTAs; k++) {
+	report.StartPhase ("distance");
+	//Distance and RSS matrices of an earlier run with the same topology and propagation
+	StageHash matrixHash = topologyHash;
+	matrixHash.Add(std::string("matrices-v2")).Add(propagationModel).Add(shadowingSigma).Add(freqBand)
+			.Add(txPower_STAdBm).Add(txPower_APdBm);
+	bool matricesCached = cache.Load("distance", matrixHash, &STA2AP_dis[0][0], STA2AP_dis.GetBytes())
+			&& cache.Load("rss-ul", matrixHash, &RSS_ULdBm[0][0], RSS_ULdBm.GetBytes())
+			&& cache.Load("rss-dl", matrixHash, &RSS_DLdBm[0][0], RSS_DLdBm.GetBytes());
+	cache.Note("matrices", matrixHash, matricesCached);
+	if (!matricesCached) {
+		pool.ParallelRows(numSTAs, 0, [&](uint32_t begin, uint32_t end) {
+			DistanceRows(begin, end, apPos, staPos, &STA2AP_dis[0][0]);
+		});
+	}
+	for (int k = 0; k < numSTAs && !matricesCached && verbose; k++) {
 		for (int kk = 0; kk < numAPs; kk++) {
-			//Call distance calculating function
-			double STA2APdistance = disAPSTA(wifiApNode.Get(kk),
-					wifiStaNode.Get(k));
-			//Store distances in an array for use later
-			STA2AP_dis[k][kk] = STA2APdistance;
+			double STA2APdistance = STA2AP_dis[k][kk];
 			std::ostringstream oss;
 			oss << "Distance between AP " << kk << " STA " << k << " "
 					<< STA2APdistance;
@@ -265,14 +3944,28 @@ int main (int argc, char *argv[])
 
 	//-----------------------------------Received Signal Strength Computation-----------------------------------
 
+	report.StartPhase ("rss");
+	if (!matricesCached) {
+		//Propagation kernel chosen once for both matrices
+		RssMatrixFn rssKernel = SelectRssKernel(propagationModel, freqBand);
+		bool shadowing = propagationModel == "logdistance-shadowing";
+		if (shadowing) {
+			g_rng.NoteRange(RNG_SHADOW, 0, numSTAs - 1);
+		}
+		pool.ParallelRows(numSTAs, 0, [&](uint32_t begin, uint32_t end) {
+			RssRows(begin, end, rssKernel, shadowing ? shadowingSigma : 0, &STA2AP_dis[0][0], &RSS_ULdBm[0][0], &RSS_DLdBm[0][0]);
+		});
+		cache.Store("distance", matrixHash, &STA2AP_dis[0][0], STA2AP_dis.GetBytes());
+		cache.Store("rss-ul", matrixHash, &RSS_ULdBm[0][0], RSS_ULdBm.GetBytes());
+		cache.Store("rss-dl", matrixHash, &RSS_DLdBm[0][0], RSS_DLdBm.GetBytes());
+	}
+
 	//Up-link RSS
 	cout << "------Up-link RSS-----------------" << endl;
-	for (int jk = 0; jk < numSTAs; jk++) {
+	for (int jk = 0; jk < numSTAs && verbose; jk++) {
 		for (int kj = 0; kj < numAPs; kj++) {
 			//Uplink RSS
-			double RSS_UL = RssValueSTAAPUL(wifiApNode.Get(kj),
-					wifiStaNode.Get(jk));
-			RSS_ULdBm[jk][kj] = RSS_UL;			//Store RSS values
+			double RSS_UL = RSS_ULdBm[jk][kj];
 			cout << "RSS from AP" << kj << " at STA " << jk << " : " << RSS_UL
 					<< endl;
 		}
@@ -280,12 +3973,10 @@ int main (int argc, char *argv[])
 
 	//Down-link RSS
 	cout << "------Down-link RSS-----------------" << endl;
-	for (int jkk = 0; jkk < numSTAs; jkk++) {
+	for (int jkk = 0; jkk < numSTAs && verbose; jkk++) {
 		for (int kkj = 0; kkj < numAPs; kkj++) {
 			//Downlink RSS
-			double RSS_DL = RssValueSTAAPDL(wifiApNode.Get(kkj),
-					wifiStaNode.Get(jkk));
-			RSS_DLdBm[jkk][kkj] = RSS_DL;		//Store RSS values
+			double RSS_DL = RSS_DLdBm[jkk][kkj];
 			//std::ostringstream oss2, oss3;
 			cout << "RSS from AP" << kkj << " at STA " << jkk << " : " << RSS_DL
 					<< endl;
@@ -297,93 +3988,232 @@ int main (int argc, char *argv[])
 	 *
 	 * */
 	//int countuser = 0;
+	report.StartPhase ("association");
+	StageHash associationHash = matrixHash;
+	associationHash.Add(std::string("association-v2"));
+	bool associationCached = cache.Load("association-ul", associationHash, &assocUL[0], numSTAs * sizeof(uint32_t))
+			&& cache.Load("association-dl", associationHash, &assocDL[0], numSTAs * sizeof(uint32_t));
+	cache.Note("association", associationHash, associationCached);
 	/*Association based on Up-link RSS*/
-	for (int ck = 0; ck < numSTAs; ck++) {
-		//Select AP with max RSS
-		double tempRss_max = RSS_ULdBm[ck][0];
-		int tempind = 0; //Stores index of max RSS
-		for (int kc = 0; kc < numAPs; kc++) {
-			if (RSS_ULdBm[ck][kc] > tempRss_max) {
-				tempRss_max = RSS_ULdBm[ck][kc];
-				Xij_DL[ck][tempind] = 0;
-				tempind = kc;
-			} else {
-				Xij_UL[ck][kc] = 0;
-			}
-		}
-		//STA_i associates with AP_j
-		Xij_UL[ck][tempind] = 1;
+	if (!associationCached) {
+		//STA_i associates with the AP_j of max RSS
+		pool.ParallelRows(numSTAs, 0, [&](uint32_t begin, uint32_t end) {
+			BestApRows(begin, end, &RSS_ULdBm[0][0], &assocUL[0]);
+		});
 	}
 
 	/*-------------------------Association based on best up-link RSS----------------------*/
 	cout << "------Up-link Association-----------------" << endl;
+	//Files opened once for all STAs, the console lines only when verbose
+	ofstream fm, fd;
+	fm.open("SSF_UL_RSS_Assoc.txt", ofstream::app);
+	fd.open("UL_AssociationDistance.txt", ofstream::app);
+	if (!fm.is_open() || !fd.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store distances in file";
+	}
 	for (int ti = 0; ti < numSTAs; ti++) {
-		for (int it = 0; it < numAPs; it++) {
-			if (Xij_UL[ti][it] == 1) {
-				//Count Number of Users that associates with each AP
-				totalUser[it] = totalUser[it] + 1;
-				cout << "STA " << ti << " associates with AP " << it
-						<< " with RSS " << RSS_ULdBm[ti][it] << endl;
-				ofstream fm, fd;
-				//Check if file is opened
-				fm.open("SSF_UL_RSS_Assoc.txt", ofstream::app);
-				fd.open("UL_AssociationDistance.txt", ofstream::app);
-				if (fm.is_open() && fd.is_open()) {
-					//Store distances to file
-					fm << " " << RSS_ULdBm[ti][it];
-					fd << " " << STA2AP_dis[ti][it];
-					fm.close();
-					fd.close();
-				} else {
-					//Throw Error Exception
-					cout << "Unable to store distances in file";
-				}
-			}
+		int it = assocUL[ti];
+		//Count Number of Users that associates with each AP
+		totalUser[it] = totalUser[it] + 1;
+		if (verbose) {
+			cout << "STA " << ti << " associates with AP " << it
+					<< " with RSS " << RSS_ULdBm[ti][it] << endl;
+		}
+		if (fm.is_open() && fd.is_open()) {
+			//Store distances to file
+			fm << " " << RSS_ULdBm[ti][it];
+			fd << " " << STA2AP_dis[ti][it];
 		}
 	}
+	fm.close();
+	fd.close();
 
-	/*------------------------------Association based on DL-link RSS----------------------*/
-	for (int cck = 0; cck < numSTAs; cck++) {
-		//Select AP with max RSS
-		double tempRss = RSS_DLdBm[cck][0];
-		int tempin = 0;
-		for (int kcc = 0; kcc < numAPs; kcc++) {
-			if (RSS_DLdBm[cck][kcc] > tempRss) {
-				tempRss = RSS_DLdBm[cck][kcc];
-				Xij_DL[cck][tempin] = 0;
-				tempin = kcc;
+	/*-------------------------Up-link SINR of the associated links----------------------
+	 * Monte Carlo over snapshots of concurrently active STAs: in each snapshot the
+	 * active STAs of other co-channel BSSs interfere at their AP, while CSMA keeps the
+	 * STAs of the same BSS from transmitting together
+	 * */
+	/*-------------------------BSS conflict graph----------------------
+	 * Interference is only summed between neighbours of the graph; without a CCA
+	 * threshold every co-channel pair of BSSs is a neighbour
+	 * */
+	ConflictGraph conflictGraph;
+	if (useConflictGraph) {
+		report.StartPhase ("conflictGraph");
+		conflictGraph.Build(apPos, assocUL, &RSS_ULdBm[0][0], &RSS_DLdBm[0][0], apChannel, SelectRssKernel(propagationModel, freqBand),
+				ccaThreshold, pool);
+		conflictGraph.Write("ConflictGraph.txt", apChannel);
+		cout << "Conflict graph at " << ccaThreshold << " dBm: " << conflictGraph.GetEdges() << " edges, "
+				<< conflictGraph.Components().size() << " independent groups of BSSs" << endl;
+	} else {
+		conflictGraph.BuildCoChannel(coChannelAPs);
+	}
+
+	report.StartPhase ("sinr");
+	//Interference at every AP averaged over the snapshots
+	std::vector<double> meanApInterferenceMw(numAPs, 0.0);
+	if (numSnapshots > 0) {
+		cout << "------Up-link SINR-----------------" << endl;
+		const std::vector<uint32_t> &servingAP = assocUL;
+		std::vector<double> servingRss(numSTAs);
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			servingRss[st] = RSS_ULdBm[st][servingAP[st]];
+		}
+		std::vector<double> fadedRss(fading != NO_FADING ? numSTAs : 0);
+		if (fading != NO_FADING) {
+			g_rng.NoteRange(RNG_FADING, 0, numSnapshots - 1);
+		}
+		std::vector<double> apInterferenceMw(numAPs);
+		std::vector<double> staInterferenceMw(numSTAs);
+		std::vector<double> sinrDb(numSTAs);
+		std::vector<double> meanSinrDb(numSTAs, 0.0);
+		//Packet error rate of every snapshot from the lookup table, for the STA's own payload
+		std::vector<double> meanPer(perMode >= 0 ? numSTAs : 0, 0.0);
+		std::vector<uint32_t> staPayload(perMode >= 0 ? numSTAs : 0);
+		for (uint32_t st = 0; st < staPayload.size(); st++) {
+			staPayload[st] = payLoadSizeGenerator(500, 1400, st);
+		}
+		std::vector<int> activeIndex;
+		for (uint32_t snap = 0; snap < numSnapshots; snap++) {
+			//Number and indexes of active STAs in this snapshot
+			int numActive = activeSTAs(1, numSTAs, snap);
+			activeIndex.resize(numActive);
+			for (int a = 0; a < numActive; a++) {
+				activeIndex[a] = actvSTAind(snap, numSTAs);
+			}
+			std::fill(apInterferenceMw.begin(), apInterferenceMw.end(), 0.0);
+			//Fading of the snapshot, drawn per pair from the counter st * numAPs + ap
+			CounterRng fadingRng(RNG_FADING, snap);
+			for (int a = 0; a < numActive; a++) {
+				int st = activeIndex[a];
+				const uint32_t *victims = conflictGraph.Neighbours(servingAP[st]);
+				uint32_t numVictims = conflictGraph.Degree(servingAP[st]);
+				for (uint32_t v = 0; v < numVictims; v++) {
+					double gain = FadingGain(fadingRng, (uint64_t) st * numAPs + victims[v], fading, ricianK);
+					apInterferenceMw[victims[v]] += gain * FastDbmToMw(RSS_ULdBm[st][victims[v]]);
+				}
+			}
+			if (fading != NO_FADING) {
+				for (uint32_t st = 0; st < numSTAs; st++) {
+					double gain = FadingGain(fadingRng, (uint64_t) st * numAPs + servingAP[st], fading, ricianK);
+					fadedRss[st] = servingRss[st] + 10 * log10(gain);
+				}
+			}
+			for (uint32_t st = 0; st < numSTAs; st++) {
+				staInterferenceMw[st] = apInterferenceMw[servingAP[st]];
+			}
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				meanApInterferenceMw[ap] += apInterferenceMw[ap] / numSnapshots;
+			}
+			SinrBatch(fading != NO_FADING ? &fadedRss[0] : &servingRss[0], &staInterferenceMw[0], numSTAs, 20, &sinrDb[0]);
+			for (uint32_t st = 0; st < numSTAs; st++) {
+				meanSinrDb[st] += sinrDb[st] / numSnapshots;
+			}
+			for (uint32_t st = 0; st < meanPer.size(); st++) {
+				meanPer[st] += perTable.GetPer(perMode, staPayload[st], sinrDb[st]) / numSnapshots;
+			}
+		}
+		if (perMode >= 0) {
+			ofstream pe;
+			pe.open("UL_PER_Assoc.txt", ofstream::app);
+			if (pe.is_open()) {
+				for (uint32_t st = 0; st < numSTAs; st++) {
+					pe << " " << meanPer[st];
+				}
+				pe.close();
 			} else {
-				//No Association
-				Xij_DL[cck][kcc] = 0;
+				//Throw Error Exception
+				cout << "Unable to store PER in file";
+			}
+		}
+		ofstream sn;
+		sn.open("UL_SINR_Assoc.txt", ofstream::app);
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			if (verbose) {
+				cout << "STA " << st << " has mean up-link SINR " << meanSinrDb[st] << " dB at AP " << servingAP[st] << endl;
+			}
+			if (sn.is_open()) {
+				sn << " " << meanSinrDb[st];
 			}
 		}
-		//STA_i associates with AP_j
-		Xij_DL[cck][tempin] = 1;
+		if (sn.is_open()) {
+			sn.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store SINR in file";
+		}
+	}
+
+	report.StartPhase ("associationDL");
+	/*------------------------------Association based on DL-link RSS----------------------*/
+	if (!associationCached) {
+		//STA_i associates with the AP_j of max RSS
+		pool.ParallelRows(numSTAs, 0, [&](uint32_t begin, uint32_t end) {
+			BestApRows(begin, end, &RSS_DLdBm[0][0], &assocDL[0]);
+		});
+	}
+
+	if (!associationCached) {
+		cache.Store("association-ul", associationHash, &assocUL[0], numSTAs * sizeof(uint32_t));
+		cache.Store("association-dl", associationHash, &assocDL[0], numSTAs * sizeof(uint32_t));
 	}
 
 	//Print Down-link Associations to screen
 	cout << "------Down-link Association-----------------" << endl;
+	ofstream fml, fdl;
+	fdl.open("DL_AssociationDistance.txt", ofstream::app);
+	fml.open("SSF_DL_RSS_Assoc.txt", ofstream::app);
+	if (!fml.is_open() || !fdl.is_open()) {
+		//Throw Error Exception
+		cout << "Unable to store distances in file";
+	}
 	for (int tii = 0; tii < numSTAs; tii++) {
-		for (int iit = 0; iit < numAPs; iit++) {
-			//Check if association exist between APj and STAi
-			if (Xij_DL[tii][iit] == 1) {
-				cout << "STA " << tii << " associates with AP " << iit
-						<< " with RSS " << RSS_DLdBm[tii][iit] << endl;
-				ofstream fml, fdl;
-				//Check if file is opened
-				fdl.open("DL_AssociationDistance.txt", ofstream::app);
-				fml.open("SSF_DL_RSS_Assoc.txt", ofstream::app);
-				if (fml.is_open() && fdl.is_open()) {
-					//Store distances to file
-					fml << " " << RSS_DLdBm[tii][iit];
-					fdl << " " << STA2AP_dis[tii][iit];
-					fml.close();
-					fdl.close();
-				} else {
-					//Throw Error Exception
-					cout << "Unable to store distances in file";
+		int iit = assocDL[tii];
+		if (verbose) {
+			cout << "STA " << tii << " associates with AP " << iit
+					<< " with RSS " << RSS_DLdBm[tii][iit] << endl;
+		}
+		if (fml.is_open() && fdl.is_open()) {
+			//Store distances to file
+			fml << " " << RSS_DLdBm[tii][iit];
+			fdl << " " << STA2AP_dis[tii][iit];
+		}
+	}
+	fml.close();
+	fdl.close();
+
+	/*-------------------------Candidate APs----------------------
+	 * The topK best APs of every STA by up-link RSS or by expected SINR, for load
+	 * balancing and handover decisions
+	 * */
+	std::vector<uint32_t> candidates;
+	if (topK > 0) {
+		std::vector<double> penaltyDb(numAPs, 0.0);
+		if (topKMetric == "sinr") {
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				penaltyDb[ap] = 10 * log10(NoiseFloorMw(20) + meanApInterferenceMw[ap]);
+			}
+		} else if (topKMetric != "rss") {
+			cout << "Unknown candidate metric " << topKMetric << ", expected rss or sinr" << endl;
+			return 1;
+		}
+		TopKCandidates(&RSS_ULdBm[0][0], penaltyDb, topK, candidates);
+		topK = std::min(topK, numAPs);
+		ofstream tk;
+		tk.open("UL_TopK_Candidates.txt");
+		if (tk.is_open()) {
+			for (uint32_t st = 0; st < numSTAs; st++) {
+				tk << st;
+				for (uint32_t c = 0; c < topK; c++) {
+					tk << " " << candidates[(uint64_t) st * topK + c];
 				}
+				tk << endl;
 			}
+			tk.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store the candidate APs in file" << endl;
 		}
 	}
 
@@ -404,188 +4234,307 @@ int main (int argc, char *argv[])
 		}
 	}
 	cout << "---------------/////////////////////////////////----------------" << endl;
+	report.StartPhase ("links");
+	//Reference loss of the link simulations, set once before the first link
+	Config::SetDefault ("ns3::LogDistancePropagationLossModel::ReferenceLoss", DoubleValue (10.046));
+	/*-------------------------Comparative mode----------------------
+	 * Every policy associates the same STAs with the same APs and RSS matrices; a link
+	 * shared by several policies is simulated once and reused, so only the (STA, AP)
+	 * pairs on which the policies differ cost extra simulations
+	 * */
+	if (!policies.empty()) {
+		std::vector<std::string> policyNames;
+		std::vector<std::vector<uint32_t> > policyServing;
+		const std::vector<uint32_t> &maxRssServing = assocUL;
+		std::istringstream list(policies);
+		std::string name;
+		while (std::getline(list, name, ',')) {
+			if (name == "maxrss") {
+				policyServing.push_back(maxRssServing);
+			} else if (name == "sinr") {
+				policyServing.push_back(SinrAssociation(&RSS_ULdBm[0][0], maxRssServing, apChannel, 0.5, 20));
+			} else if (name == "load") {
+				policyServing.push_back(LoadAwareAssociation(&RSS_ULdBm[0][0], candidates, topK));
+			} else {
+				cout << "Unknown association policy " << name << endl;
+				return 1;
+			}
+			policyNames.push_back(name);
+		}
+		//Throughput of every STA under every policy, copied from an earlier policy serving it by the same AP
+		std::vector<std::vector<double> > policyThroughput(policyServing.size(), std::vector<double>(numSTAs, 0));
+		uint32_t simulated = 0;
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			if (!InShard(shard, st)) {
+				continue;
+			}
+			int payLoadSize = payLoadSizeGenerator(500, 1400, st);
+			for (uint32_t p = 0; p < policyServing.size(); p++) {
+				uint32_t ap = policyServing[p][st];
+				uint32_t q = 0;
+				while (q < p && policyServing[q][st] != ap) {
+					q++;
+				}
+				if (q < p) {
+					policyThroughput[p][st] = policyThroughput[q][st];
+					continue;
+				}
+				g_traceLink = st;
+				policyThroughput[p][st] = CachedLinkThroughput (cache, STA2AP_dis[st][ap], payLoadSize, 0, 20, false, simulationTime,
+						fastStart, g_rng.GetStream (RNG_LINK, (uint64_t) st * numAPs + ap));
+				simulated++;
+			}
+		}
+		cout << simulated << " link simulations for " << policyNames.size() << " policies and " << numSTAs << " STAs" << endl;
+		ofstream cmp;
+		cmp.open("PolicyComparison.txt");
+		if (cmp.is_open()) {
+			cmp << "STA";
+			for (uint32_t p = 0; p < policyNames.size(); p++) {
+				cmp << "\t" << policyNames[p] << "_AP\t" << policyNames[p] << "_RSS\t" << policyNames[p] << "_Mbps";
+			}
+			cmp << endl;
+			for (uint32_t st = 0; st < numSTAs; st++) {
+				if (!InShard(shard, st)) {
+					continue;
+				}
+				cmp << st;
+				for (uint32_t p = 0; p < policyNames.size(); p++) {
+					uint32_t ap = policyServing[p][st];
+					cmp << "\t" << ap << "\t" << RSS_ULdBm[st][ap] << "\t" << policyThroughput[p][st];
+				}
+				cmp << endl;
+			}
+			cmp.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store the policy comparison in file" << endl;
+		}
+		for (uint32_t p = 0; p < policyNames.size(); p++) {
+			std::vector<BssAccumulator> policyBss(numAPs);
+			BssAccumulator policyNetwork;
+			for (uint32_t st = 0; st < numSTAs; st++) {
+				if (!InShard(shard, st)) {
+					continue;
+				}
+				policyBss[policyServing[p][st]].Add(policyThroughput[p][st]);
+				policyNetwork.Add(policyThroughput[p][st]);
+			}
+			WriteBssSummary (policyBss, policyNetwork, "BPSK_BSS_Summary_" + policyNames[p] + ".txt");
+			cout << "Policy " << policyNames[p] << ": " << policyNetwork.GetSum() << " Mbps total, Jain index "
+					<< policyNetwork.GetJainIndex() << endl;
+		}
+	}
+
+	/*-------------------------Per-BSS contention----------------------
+	 * One simulation per AP with all its up-link associated STAs sending traffic, so the
+	 * throughput of a STA reflects the number of STAs sharing its AP; with the conflict
+	 * graph, one simulation per group of BSSs that can hear each other
+	 * */
+	if (bssContention) {
+		std::vector<std::vector<uint32_t> > members(numAPs);
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			members[assocUL[st]].push_back(st);
+		}
+		//BSSs of a connected component of the conflict graph contend in one simulation, otherwise each BSS alone
+		std::vector<std::vector<uint32_t> > groups;
+		if (useConflictGraph) {
+			groups = conflictGraph.Components();
+		} else {
+			for (uint32_t ap = 0; ap < numAPs; ap++) {
+				groups.push_back(std::vector<uint32_t>(1, ap));
+			}
+		}
+		std::vector<double> staThroughput = ParallelBssThroughput(members, groups, wifiApNode, wifiStaNode, simulationTime,
+				fastStart, bssWorkers);
+		std::vector<BssAccumulator> contentionBss(numAPs);
+		BssAccumulator contentionNetwork;
+		ofstream ct;
+		ct.open("BSS_Contention_Throughput.txt");
+		for (uint32_t ap = 0; ap < numAPs; ap++) {
+			for (uint32_t m = 0; m < members[ap].size(); m++) {
+				uint32_t st = members[ap][m];
+				cout << "STA " << st << " in BSS " << ap << " of " << members[ap].size() << " STAs: "
+						<< staThroughput[st] << " Mbps" << endl;
+				if (ct.is_open()) {
+					ct << st << "\t" << ap << "\t" << members[ap].size() << "\t" << staThroughput[st] << endl;
+				}
+				if (staThroughput[st] >= 0) {
+					contentionBss[ap].Add(staThroughput[st]);
+					contentionNetwork.Add(staThroughput[st]);
+				}
+			}
+		}
+		if (ct.is_open()) {
+			ct.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store the BSS contention throughput in file" << endl;
+		}
+		WriteBssSummary (contentionBss, contentionNetwork, "BPSK_BSS_Summary_Contention.txt");
+	}
+
 	//ofstream sim;
 	std::cout <<"STA" << "\t\t" << "AP" << "\t\t" <<"Packet Size" << "\t\t" << "MCS value" << "\t\t" << "Channel width" << "\t\t" << "short GI" << "\t\t" << "Throughput" << '\n';
 
 	//Iterate through the APs
-	for(int ji = 0; ji < numSTAs; ji++){
-		//Iterate through the STAs
-		for(int ij = 0; ij < numAPs; ij++){
-			//Up-link SINR for each STA
-
-			//Check if there is an association between between STA_i and AP_j
-			if (Xij_UL[ji][ij] == 1) {
-				//Store BSS ID
-				ofstream bs;
-				bs.open("BPSK_BSS_ID.txt", ofstream::app);//Store BSS ID for each STA
-				bs << " " << ij;
-				bs.close();
-				//Get the distance between STA_i and AP_j
-				distance = STA2AP_dis[ji][ij];
-				//Modulation and Coding Schemes
-				//i ranges from 0 to 7; 0 is for BPSK while 1 is QPSK
-				for (int i = 0; i < 1; i++)
+	//The comparative and BSS contention modes replace the per-STA loop of the max-RSS association
+	bool perLinkLoop = policies.empty() && !bssContention && benchmark.empty();
+	/*-------------------------Stratified sampling----------------------
+	 * The sampled links are simulated first; the per-STA loop below then reads the
+	 * simulated or estimated throughput of every STA instead of simulating it
+	 * */
+	StratifiedSampler sampler (distanceBand, payloadBucket, samplePerStratum);
+	if (perLinkLoop && samplePerStratum > 0) {
+		for (uint32_t st = 0; st < numSTAs; st++) {
+			uint32_t ap = assocUL[st];
+			if (!InShard(shard, st)) {
+				continue;
+			}
+			int payLoadSize = payLoadSizeGenerator(500, 1400, st);
+			if (sampler.Add(st, STA2AP_dis[st][ap], payLoadSize)) {
+				g_traceLink = st;
+				sampler.SetResult(st, CachedLinkThroughput (cache, STA2AP_dis[st][ap], payLoadSize, 0, 20, false, simulationTime,
+						fastStart, g_rng.GetStream (RNG_LINK, (uint64_t) st * numAPs + ap)));
+			}
+		}
+		sampler.Estimate();
+		sampler.Write("SamplingStrata.txt");
+		cout << sampler.GetSimulated() << " of " << numSTAs << " links simulated, the others estimated" << endl;
+	}
+	//Per-link outputs go through the writer thread; an interrupt stops the loop after the current link
+	ResultWriter resultWriter (resultQueue);
+	resultWriter.Start (sharded);
+	signal (SIGINT, InterruptHandler);
+	signal (SIGTERM, InterruptHandler);
+	for(int ji = 0; ji < numSTAs && perLinkLoop && !g_interrupted; ji++){
+		//Links of other shards are simulated by their own process
+		if (!InShard(shard, ji)) {
+			continue;
+		}
+		//AP associated with STA_i
+		int ij = assocUL[ji];
+		//Get the distance between STA_i and AP_j
+		distance = STA2AP_dis[ji][ij];
+		//Modulation and Coding Schemes
+		//i ranges from 0 to 7; 0 is for BPSK while 1 is QPSK
+		for (int i = 0; i < 1; i++)
+		{
+			//Channel Width - Could be 20 MHz or 40 MHz
+			for (int j = 20; j <= 20; )
+			{
+				//IEEE 802.11n Guard Interval; 0 or 1
+				for (int k = 0; k < 1; k++)
 				{
-					//Channel Width - Could be 20 MHz or 40 MHz
-					for (int j = 20; j <= 20; )
-					{
-						//IEEE 802.11n Guard Interval; 0 or 1
-						for (int k = 0; k < 1; k++)
-						{
-							//IP Packet Size in bytes
-							//Call the Packet Generator function
-							int minPktSi = 500; //Minimum Packet Size
-							int maxPktSi = 1400; //Maximum Packet Size
-							int payLoadSize;
-							payLoadSize = payLoadSizeGenerator(minPktSi, maxPktSi);
-							//Save Transmitted Packet Size to file and vector
-							packetSizes[ji] = payLoadSize; //Payload size changes for each user randomly
-
-							ofstream pktsi;
-							//Create file for Packet Size
-							pktsi.open("BPSK_PacketSizeSent.txt", ofstream::app);
-							if(pktsi.is_open()){
-								pktsi << " " << payLoadSize;
-								//Close the file
-								pktsi.close();
-							} else {
-								//Throw error exception
-								cout << "File does not exist";
-							}
-							NodeContainer staNode; //Inner Node Container
-							staNode.Create (1);
-							//AP Node container
-							NodeContainer apNodes;
-							apNodes.Create (1);
-							//Wifi Helper
-							YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
-							YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
-							phy.SetChannel (channel.Create ());
-							// Set guard interval
-							phy.Set ("ShortGuardEnabled", BooleanValue (k));
-							//Call Wifi Mac Class
-							WifiMacHelper mac;
-							WifiHelper wifi;
-							//Set Wifi Stanard 802.11n on 2.4GHz ISM band
-							wifi.SetStandard (WIFI_PHY_STANDARD_80211n_2_4GHZ);
-							Config::SetDefault ("ns3::LogDistancePropagationLossModel::ReferenceLoss", DoubleValue (10.046));
-							std::ostringstream oss;
-							oss << "HtMcs" << i;
-							wifi.SetRemoteStationManager ("ns3::ConstantRateWifiManager","DataMode", StringValue (oss.str ()),
-									"ControlMode", StringValue (oss.str ()));
-
-							Ssid ssid = Ssid ("cisc825-80211nWifi");
-							//ns3::StaWifiMac class implements an active probing and association state
-									//machine that handles automatic re-association whenever too many beacons are missed
-							mac.SetType ("ns3::StaWifiMac",
-									"Ssid", SsidValue (ssid),
-									"ActiveProbing", BooleanValue (false));
-							NetDeviceContainer staDevice;
-							staDevice = wifi.Install (phy, mac, staNode);
-							//ns3::ApWifiMac implements an AP that generates periodic beacons, and that accepts every attempt to associate.
-							mac.SetType ("ns3::ApWifiMac",
-									"Ssid", SsidValue (ssid));
-							//Device Containers
-							NetDeviceContainer apDevice;
-							apDevice = wifi.Install (phy, mac, apNodes);
-							// Set channel width
-							Config::Set ("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/ChannelWidth", UintegerValue (j));
-							// mobility.
-							MobilityHelper mobility;
-							Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator> ();
-							//Place node in position
-							positionAlloc->Add (Vector (0.0, 0.0, 0.0));
-							positionAlloc->Add (Vector (distance, 0.0, 0.0));
-							mobility.SetPositionAllocator (positionAlloc);
-							//Define Mobility Model
-							mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
-							//Install Mobility on Nodes
-							mobility.Install (apNodes);
-							mobility.Install (staNode);
-
-							/* Internet stack*/
-							InternetStackHelper stack;
-							stack.Install (apNodes);
-							stack.Install (staNode);
-
-							//Set IP Addresses
-							Ipv4AddressHelper address;
-							//Address base
-							/*
-							 * Define IP Address Class
-							 * Mask address is set to 255.255.0.0 to have more addresses for large number of stations
-							 * Also IP address starts from 192.168.0.0 to accommodate more users.
-							 * */
-							address.SetBase ("192.168.1.0", "255.255.255.0");
-							//Interfaces for IP Address
-							Ipv4InterfaceContainer staNodeInterface;
-							Ipv4InterfaceContainer apNodeInterface;
-							//Assign IP Addresses to Nodes
-							staNodeInterface = address.Assign (staDevice);
-							apNodeInterface = address.Assign (apDevice);
-
-							/*
-							 * Setting applications
-							 * We are mainly sending UDP Packet
-							 * */
-							ApplicationContainer serverApp;
-								//UDP Packet flow
-								UdpServerHelper myServer (9);
-								serverApp = myServer.Install (staNode.Get (0));
-								serverApp.Start (Seconds (0.0));
-								serverApp.Stop (Seconds (simulationTime + 1));
-								//UDP Client Side
-								UdpClientHelper myClient (staNodeInterface.GetAddress (0), 9);
-								//Set Packet Size, interval and maximum packet
-								myClient.SetAttribute ("MaxPackets", UintegerValue (4294967295u));
-								myClient.SetAttribute ("Interval", TimeValue (Time ("0.00001"))); //packets/s
-								myClient.SetAttribute ("PacketSize", UintegerValue (payLoadSize));
-
-								ApplicationContainer clientApp = myClient.Install (apNodes.Get (0));
-								clientApp.Start (Seconds (1.0));
-								clientApp.Stop (Seconds (simulationTime + 1));
-
-							Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
-
-							//----------------------------------------Network Animation------------------------------------
-							AnimationInterface anim("cisc825-apselectionscheme.xml");
-
-							//LogComponentEnable("InterferenceHelper", LOG_LEVEL_ALL);
-
-							//Run Simulator
-							Simulator::Stop (Seconds (simulationTime + 1));
-							Simulator::Run ();
-							Simulator::Destroy ();
-
-							//Calculate End-to-End Throughput
-							double throughput = 0;
-								uint32_t totalPacketsThrough = DynamicCast<UdpServer> (serverApp.Get (0))->GetReceived ();
-								throughput = totalPacketsThrough * payLoadSize * 8 / (simulationTime * 1000000.0); //Mbit/s
-
-							//Write throughput to file for analysis
-							ofstream trput, sim;
-							//Check or create file
-							trput.open("BPSK_Throughput_RSS_VaryPkt.txt", ofstream::app);
-							sim.open("BPSK_Simulation_Traces_VaryPkt.txt", ofstream::app);
-							std::cout << ji << "\t\t" << ij << "\t\t" << payLoadSize << " bytes\t\t" << i << "\t\t\t" << j << " MHz\t\t\t" << k
-									<< "\t\t\t" << throughput << " Mbps" << std::endl;
-							//Check if file is open
-							if(trput.is_open() & sim.is_open()){
-								//Write throughput to file
-								trput << " " << throughput;
-								sim << ji << "\t\t" << ij << "\t\t" << payLoadSize << " bytes\t\t" << i << "\t\t\t" << j << " MHz\t\t\t" << k
-										<< "\t\t\t" << throughput << " Mbps" <<endl;
-								trput.close();
-							} else {
-								//Throw Error Exception
-								cout << "Error Opening the throughput file" <<endl;
-							}
-						}
-						j *= 2;
+					//IP Packet Size in bytes
+					//Call the Packet Generator function
+					int minPktSi = 500; //Minimum Packet Size
+					int maxPktSi = 1400; //Maximum Packet Size
+					int payLoadSize;
+					payLoadSize = payLoadSizeGenerator(minPktSi, maxPktSi, ji);
+					//Save Transmitted Packet Size to vector, the writer thread stores it with the BSS ID
+					packetSizes[ji] = payLoadSize; //Payload size changes for each user randomly
+					LinkResultRecord record = LinkResultRecord();
+					record.sta = ji;
+					record.ap = ij;
+					record.payLoadSize = payLoadSize;
+					record.mcs = i;
+					record.channelW = j;
+					record.sgi = k;
+					double throughput;
+					if (samplePerStratum > 0) {
+						//Simulated above or estimated from the stratum
+						throughput = sampler.GetThroughput(ji);
+						record.sampled = true;
+						record.simulated = sampler.IsSampled(ji);
+						record.halfWidth = sampler.GetHalfWidth(ji);
+					} else {
+						//Run the link simulation between STA_i and AP_j
+						g_traceLink = ji;
+						throughput = CachedLinkThroughput (cache, distance, payLoadSize, i, j, k, simulationTime, fastStart,
+								g_rng.GetStream (RNG_LINK, (uint64_t) ji * numAPs + ij));
+					}
+					bssStats[ij].Add (throughput);
+					networkStats.Add (throughput);
+					record.throughput = throughput;
+					//Delay statistics for links simulated in this loop
+					if (flowStats && samplePerStratum == 0) {
+						record.hasDelay = true;
+						record.txPackets = linkStats.txPackets;
+						record.rxPackets = linkStats.rxPackets;
+						record.lossRatio = linkStats.lossRatio;
+						record.meanDelay = linkStats.meanDelay;
+						record.meanJitter = linkStats.meanJitter;
+						record.p50 = linkStats.p50;
+						record.p95 = linkStats.p95;
+						record.p99 = linkStats.p99;
 					}
+					//Formatted and written by the writer thread while the next link is simulated
+					resultWriter.Push (record);
 				}
+				j *= 2;
 			}
 		}
 	}
+	resultWriter.Stop ();
+	signal (SIGINT, SIG_DFL);
+	signal (SIGTERM, SIG_DFL);
+	report.EndPhase ();
+	if (g_interrupted) {
+		cout << "Interrupted, stopped after " << resultWriter.GetWritten () << " links whose results are stored" << endl;
+	}
+	if (resultWriter.GetBlocked () > 0) {
+		cout << "The link loop waited " << resultWriter.GetBlocked () << " times for the result writer" << endl;
+	}
+	//Per-BSS totals, means and fairness without a post-processing pass
+	WriteBssSummary (bssStats, networkStats, "BPSK_BSS_Summary.txt");
+	//Streams used by this run, to reproduce it in parallel or sharded form
+	g_rng.WriteAssignments ("RngStreams.txt");
+	if (g_packetTrace != 0) {
+		packetTraceWriter.Stop ();
+		cout << packetTraceWriter.GetWritten () << " packet trace records written, "
+				<< packetTraceWriter.GetRing ().GetDropped () << " dropped on overflow" << endl;
+	}
+	if (!benchmarkJson.empty ()) {
+		report.SetText ("status", g_interrupted ? "interrupted" : "ok");
+		report.Write (benchmarkJson);
+	}
+	if (profileEvents) {
+		cout << "------Event Profile (" << g_eventProfile.GetEvents () << " events)-----------------" << endl;
+		g_eventProfile.WriteTable (cout, 20);
+		ofstream ep;
+		ep.open("EventProfile.txt");
+		if (ep.is_open()) {
+			g_eventProfile.WriteTable (ep, UINT32_MAX);
+			ep.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to store the event profile in file" << endl;
+		}
+		g_eventProfile.WriteFolded ("EventProfile.folded");
+	}
+	//RSS by phase, live objects by type and link growth
+	g_memory.CheckSurvivors ();
+	g_memory.Write ("MemoryReport.txt", report);
+	if (g_memory.IsLeaking ()) {
+		cout << "Memory keeps growing across the link simulations, see MemoryReport.txt" << endl;
+	}
+	if (g_interrupted) {
+		//An interrupted shard stays incomplete so that it is run again
+		return 1;
+	}
+	if (sharded) {
+		//Marks the shard as complete for the merge
+		ofstream done;
+		done.open("ShardComplete.txt");
+		if (done.is_open()) {
+			done << shard.index << "/" << shard.count << endl;
+			done.close();
+		} else {
+			//Throw Error Exception
+			cout << "Unable to mark the shard complete" << endl;
+			return 1;
+		}
+	}
 	return 0;
 }
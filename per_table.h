@@ -0,0 +1,248 @@
+/*
+ SINR to packet error rate lookup table shared by the interference experiments,
+ which generate it (wifi_interference.cc --perTable), and the association and
+ analytic throughput code, which read it instead of running PHY simulations.
+*/
+#ifndef PER_TABLE_H
+#define PER_TABLE_H
+
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+/* Packet error rate lookup table, indexed by Wifi mode, packet size and SINR
+ *
+ * Binary layout (little endian, as written by the host):
+ *   char[4] "PERT", uint32 version, uint32 nModes, uint32 nSizes, uint32 nSinr,
+ *   float sinrMin, float sinrStep,
+ *   nModes x char[16] mode names, nSizes x uint32 packet sizes (ascending),
+ *   nModes x nSizes x nSinr float PER values on the uniform SINR grid
+ * */
+class PerTable
+{
+public:
+  PerTable ();
+  //Empty table on a uniform SINR grid (dB)
+  PerTable (const std::vector<std::string> &modes, const std::vector<uint32_t> &sizes,
+            double sinrMin, double sinrStep, uint32_t nSinr);
+  bool Save (std::string fileName) const;
+  bool Load (std::string fileName);
+  /*Resample measured (SINR, PER) points onto the grid of one mode and size.
+   * PER is forced non-increasing in SINR and held constant beyond the measured range
+   * */
+  void SetCurve (uint32_t mode, uint32_t size, std::vector<std::pair<double, double> > points);
+  /*PER of a frame, linearly interpolated in SINR and in packet size
+   * */
+  double GetPer (uint32_t mode, uint32_t packetSize, double sinrDb) const;
+  int32_t GetModeIndex (std::string mode) const;
+
+private:
+  double Interpolate (uint32_t mode, uint32_t size, double sinrDb) const;
+  std::vector<std::string> m_modes;
+  std::vector<uint32_t> m_sizes;
+  float m_sinrMin;
+  float m_sinrStep;
+  uint32_t m_nSinr;
+  std::vector<float> m_per;
+};
+
+inline
+PerTable::PerTable ()
+  : m_sinrMin (0),
+    m_sinrStep (1),
+    m_nSinr (0)
+{
+}
+
+inline
+PerTable::PerTable (const std::vector<std::string> &modes, const std::vector<uint32_t> &sizes,
+                    double sinrMin, double sinrStep, uint32_t nSinr)
+  : m_modes (modes),
+    m_sizes (sizes),
+    m_sinrMin (sinrMin),
+    m_sinrStep (sinrStep),
+    m_nSinr (nSinr),
+    m_per (modes.size () * sizes.size () * nSinr, 1.0)
+{
+  std::sort (m_sizes.begin (), m_sizes.end ());
+}
+
+inline void
+PerTable::SetCurve (uint32_t mode, uint32_t size, std::vector<std::pair<double, double> > points)
+{
+  std::sort (points.begin (), points.end ());
+  //Running minimum from low to high SINR removes Monte Carlo noise
+  for (uint32_t k = 1; k < points.size (); k++)
+    {
+      points[k].second = std::min (points[k].second, points[k - 1].second);
+    }
+  float *row = &m_per[(mode * m_sizes.size () + size) * m_nSinr];
+  uint32_t k = 0;
+  for (uint32_t g = 0; g < m_nSinr; g++)
+    {
+      double sinr = m_sinrMin + g * m_sinrStep;
+      while (k + 1 < points.size () && points[k + 1].first <= sinr)
+        {
+          k++;
+        }
+      if (points.empty ())
+        {
+          row[g] = 1.0;
+        }
+      else if (sinr <= points[0].first)
+        {
+          row[g] = points[0].second;
+        }
+      else if (k + 1 >= points.size ())
+        {
+          row[g] = points.back ().second;
+        }
+      else
+        {
+          double w = (sinr - points[k].first) / (points[k + 1].first - points[k].first);
+          row[g] = points[k].second + w * (points[k + 1].second - points[k].second);
+        }
+    }
+}
+
+inline double
+PerTable::Interpolate (uint32_t mode, uint32_t size, double sinrDb) const
+{
+  const float *row = &m_per[(mode * m_sizes.size () + size) * m_nSinr];
+  double x = (sinrDb - m_sinrMin) / m_sinrStep;
+  if (x <= 0)
+    {
+      return row[0];
+    }
+  if (x >= m_nSinr - 1)
+    {
+      return row[m_nSinr - 1];
+    }
+  uint32_t g = (uint32_t) x;
+  double w = x - g;
+  return row[g] + w * (row[g + 1] - row[g]);
+}
+
+inline double
+PerTable::GetPer (uint32_t mode, uint32_t packetSize, double sinrDb) const
+{
+  //A table that was never filled or loaded loses every frame
+  if (m_per.empty ())
+    {
+      return 1.0;
+    }
+  std::vector<uint32_t>::const_iterator it = std::lower_bound (m_sizes.begin (), m_sizes.end (), packetSize);
+  if (it == m_sizes.begin ())
+    {
+      return Interpolate (mode, 0, sinrDb);
+    }
+  if (it == m_sizes.end ())
+    {
+      return Interpolate (mode, m_sizes.size () - 1, sinrDb);
+    }
+  uint32_t hi = it - m_sizes.begin ();
+  double w = double (packetSize - m_sizes[hi - 1]) / (m_sizes[hi] - m_sizes[hi - 1]);
+  return (1 - w) * Interpolate (mode, hi - 1, sinrDb) + w * Interpolate (mode, hi, sinrDb);
+}
+
+inline int32_t
+PerTable::GetModeIndex (std::string mode) const
+{
+  for (uint32_t m = 0; m < m_modes.size (); m++)
+    {
+      if (m_modes[m] == mode)
+        {
+          return m;
+        }
+    }
+  return -1;
+}
+
+inline bool
+PerTable::Save (std::string fileName) const
+{
+  std::ofstream out (fileName.c_str (), std::ios::binary);
+  if (!out.is_open ())
+    {
+      return false;
+    }
+  uint32_t header[4] = {1, (uint32_t) m_modes.size (), (uint32_t) m_sizes.size (), m_nSinr};
+  out.write ("PERT", 4);
+  out.write ((const char *) header, sizeof (header));
+  out.write ((const char *) &m_sinrMin, sizeof (float));
+  out.write ((const char *) &m_sinrStep, sizeof (float));
+  for (uint32_t m = 0; m < m_modes.size (); m++)
+    {
+      char name[16] = {0};
+      m_modes[m].copy (name, sizeof (name) - 1);
+      out.write (name, sizeof (name));
+    }
+  out.write ((const char *) &m_sizes[0], m_sizes.size () * sizeof (uint32_t));
+  out.write ((const char *) &m_per[0], m_per.size () * sizeof (float));
+  return out.good ();
+}
+
+inline bool
+PerTable::Load (std::string fileName)
+{
+  std::ifstream in (fileName.c_str (), std::ios::binary);
+  char magic[4];
+  uint32_t header[4];
+  if (!in.read (magic, 4) || std::string (magic, 4) != "PERT"
+      || !in.read ((char *) header, sizeof (header)) || header[0] != 1)
+    {
+      return false;
+    }
+  //An empty grid has no row to interpolate in; the bounds keep a corrupt header from allocating gigabytes
+  uint32_t nModes = header[1], nSizes = header[2], nSinr = header[3];
+  if (nModes == 0 || nSizes == 0 || nSinr == 0 || nModes > 1024 || nSizes > 65536 || nSinr > 65536)
+    {
+      return false;
+    }
+  float sinrMin, sinrStep;
+  if (!in.read ((char *) &sinrMin, sizeof (float)) || !in.read ((char *) &sinrStep, sizeof (float))
+      || !(sinrStep > 0))
+    {
+      return false;
+    }
+  std::vector<std::string> modes (nModes);
+  for (uint32_t m = 0; m < nModes; m++)
+    {
+      char name[16];
+      if (!in.read (name, sizeof (name)))
+        {
+          return false;
+        }
+      modes[m] = std::string (name, strnlen (name, sizeof (name)));
+    }
+  std::vector<uint32_t> sizes (nSizes);
+  if (!in.read ((char *) &sizes[0], nSizes * sizeof (uint32_t)))
+    {
+      return false;
+    }
+  for (uint32_t s = 1; s < nSizes; s++)
+    {
+      if (sizes[s] <= sizes[s - 1])
+        {
+          return false;
+        }
+    }
+  std::vector<float> per ((uint64_t) nModes * nSizes * nSinr);
+  if (!in.read ((char *) &per[0], per.size () * sizeof (float)))
+    {
+      return false;
+    }
+  //The table is only replaced once it is read completely
+  m_modes.swap (modes);
+  m_sizes.swap (sizes);
+  m_per.swap (per);
+  m_sinrMin = sinrMin;
+  m_sinrStep = sinrStep;
+  m_nSinr = nSinr;
+  return true;
+}
+
+#endif /* PER_TABLE_H */
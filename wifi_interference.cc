@@ -30,6 +30,14 @@
 #include "ns3/nstime.h"
 #include "ns3/command-line.h"
 #include "ns3/wifi-tx-vector.h"
+#include "per_table.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 using namespace ns3;
 
@@ -58,6 +66,133 @@ int payLoadSizeGenerator(int minPktSize, int maxPktSize){
 	return ra->GetInteger(minPktSize, maxPktSize);
 }
 
+
+/*Per-frame record of the receiver AP, written as is to the binary trace
+ * */
+struct RxRecord
+{
+  int64_t timeNs; //Simulation time of the receive event
+  uint32_t trial; //Trial the frame belongs to
+  uint32_t packetSize;
+  float sinr; //SINR reported by the PHY in dB, NaN for dropped frames
+  float nominalSinr; //Nominal SINR of the trial in dB
+  uint8_t event; //RX_OK, RX_ERROR or RX_DROP
+  uint8_t desired; //1 for the frame of the desired transmitter
+  uint16_t reserved;
+};
+
+enum RxEvent
+{
+  RX_OK = 0,
+  RX_ERROR = 1,
+  RX_DROP = 2
+};
+
+/*Preallocated buffer of receive records. Appending never allocates; when the
+ * buffer is full it is written out in one block, or the record is counted as
+ * lost if no file was given
+ * */
+class RxRecordBuffer
+{
+public:
+  RxRecordBuffer ();
+  ~RxRecordBuffer ();
+  bool Open (std::string fileName, uint32_t capacity);
+  void Append (const struct RxRecord &record);
+  void Flush (void);
+  void Close (void);
+  uint64_t GetWritten (void) const;
+  uint64_t GetLost (void) const;
+
+private:
+  std::vector<struct RxRecord> m_records;
+  uint32_t m_used;
+  FILE *m_file;
+  uint64_t m_written;
+  uint64_t m_lost;
+};
+
+RxRecordBuffer::RxRecordBuffer ()
+  : m_used (0),
+    m_file (0),
+    m_written (0),
+    m_lost (0)
+{
+}
+
+RxRecordBuffer::~RxRecordBuffer ()
+{
+  Close ();
+}
+
+/*File layout: char[4] "RXRC", uint32 version, uint32 record size, then the records
+ * */
+bool
+RxRecordBuffer::Open (std::string fileName, uint32_t capacity)
+{
+  Close ();
+  m_records.resize (std::max (capacity, 1u));
+  m_used = 0;
+  m_file = fopen (fileName.c_str (), "wb");
+  if (m_file == 0)
+    {
+      return false;
+    }
+  uint32_t header[2] = {1, sizeof (struct RxRecord)};
+  fwrite ("RXRC", 1, 4, m_file);
+  fwrite (header, sizeof (uint32_t), 2, m_file);
+  return true;
+}
+
+void
+RxRecordBuffer::Append (const struct RxRecord &record)
+{
+  if (m_used == m_records.size ())
+    {
+      Flush ();
+      if (m_used == m_records.size ())
+        {
+          m_lost++;
+          return;
+        }
+    }
+  m_records[m_used++] = record;
+}
+
+void
+RxRecordBuffer::Flush (void)
+{
+  if (m_file == 0 || m_used == 0)
+    {
+      return;
+    }
+  m_written += fwrite (&m_records[0], sizeof (struct RxRecord), m_used, m_file);
+  m_used = 0;
+}
+
+void
+RxRecordBuffer::Close (void)
+{
+  Flush ();
+  if (m_file != 0)
+    {
+      fclose (m_file);
+      m_file = 0;
+    }
+}
+
+uint64_t
+RxRecordBuffer::GetWritten (void) const
+{
+  return m_written;
+}
+
+uint64_t
+RxRecordBuffer::GetLost (void) const
+{
+  return m_lost;
+}
+
 /*
  * Declare inputs for the interference measurement
  * using struct
@@ -65,6 +200,17 @@ int payLoadSizeGenerator(int minPktSize, int maxPktSize){
 class InterferenceMeasurement
 {
 public:
+  /*One interfering transmitter of a trial
+   * */
+  struct Interferer
+  {
+    Interferer ();
+    double position; //X position of the interfering node
+    std::string txMode; //Wifi Mode of the interfering node
+    uint32_t txPowerLevel; //Transmit power level, see Input::txPowerStart
+    uint32_t packetSize;
+    Time offset; //Start of the interfering frame relative to the desired frame
+  };
   struct Input
   {
     Input ();
@@ -88,46 +234,226 @@ public:
      * */
     enum WifiPhyStandard standard;
     enum WifiPreamble preamble;
+    /*Transmit power range of all PHYs in dBm, the power of level l is
+     * txPowerStart + l * (txPowerEnd - txPowerStart) / (nTxPower - 1)
+     * */
+    double txPowerStart;
+    double txPowerEnd;
+    uint32_t nTxPower;
+    /*Interfering nodes of this trial. When empty, a single interferer
+     * is built from pos_InterfSignal, txModeB, txPowerLevelB, packetSizeB and interval
+     * */
+    std::vector<Interferer> interferers;
   };
   //Interference Experiment
   InterferenceMeasurement ();
   void Run (struct InterferenceMeasurement::Input input);
+  /*Run all trials inside one simulator lifetime. Trial t starts at t * spacing,
+   * so spacing must exceed the longest offset plus frame duration of any trial
+   * for the trials not to interact
+   * */
+  void Run (const std::vector<struct InterferenceMeasurement::Input> &trials, Time spacing);
+
+  /*Result of a trial at the receiver AP
+   * */
+  struct Outcome
+  {
+    bool received; //The desired frame was synchronised on by the receiver
+    bool success; //The desired frame was decoded
+    double sinr; //Nominal SINR of the desired frame in dB
+  };
+  //Outcomes of the trials of the last Run, in trial order
+  const std::vector<struct Outcome> & GetOutcomes (void) const;
+  /*Capture every frame seen by the receiver AP into a buffer of capacity
+   * records, flushed in bulk to a binary file
+   * */
+  bool EnableRxTrace (std::string fileName, uint32_t capacity);
+  uint64_t GetRxTraceWritten (void) const;
+  uint64_t GetRxTraceLost (void) const;
 
 private:
   /*Send Methods for desired signal and interferer
    * */
-  void DesiredSend (void) const;
-  void InterfererSend (void) const;
+  void StartTrial (uint32_t trial);
+  void DesiredSend (uint32_t trial);
+  void InterfererSend (uint32_t trial, uint32_t interferer) const;
+  /*Receive callbacks of the receiver AP
+   * */
+  void RxOk (Ptr<Packet> p, double snr, WifiTxVector txVector, enum WifiPreamble preamble);
+  void RxError (Ptr<Packet> p, double snr);
+  void RxDrop (Ptr<const Packet> p);
+  void Record (Ptr<const Packet> p, double snr, enum RxEvent event);
+  double PowerDbm (const struct Input &input, uint32_t level) const;
   Ptr<YansWifiPhy> m_txA;
-  Ptr<YansWifiPhy> m_txB;
-  struct Input m_input;
+  Ptr<YansWifiPhy> m_rx;
+  Ptr<MobilityModel> m_posA;
+  //Pool of interfering transmitters, repositioned at the start of every trial
+  std::vector<Ptr<YansWifiPhy> > m_txB;
+  std::vector<Ptr<MobilityModel> > m_posB;
+  std::vector<struct Input> m_trials;
+  std::vector<struct Outcome> m_outcome;
+  uint32_t m_currentTrial;
+  uint64_t m_desiredUid;
+  bool m_rxTrace;
+  RxRecordBuffer m_rxRecords;
 };
 
 /*Method for allowing desired node transmit
  * */
 void
-InterferenceMeasurement::DesiredSend (void) const
+InterferenceMeasurement::DesiredSend (uint32_t trial)
 {
-  Ptr<Packet> p = Create<Packet> (m_input.packetSizeA);
+  const struct Input &input = m_trials[trial];
+  Ptr<Packet> p = Create<Packet> (input.packetSizeA);
+  //The receiver matches its callbacks against this frame
+  m_desiredUid = p->GetUid ();
   WifiTxVector txVector;
-  txVector.SetTxPowerLevel (m_input.txPowerLevelA);
-  txVector.SetMode (WifiMode (m_input.txModeA));
-  m_txA->SendPacket (p, txVector, m_input.preamble);
+  txVector.SetTxPowerLevel (input.txPowerLevelA);
+  txVector.SetMode (WifiMode (input.txModeA));
+  m_txA->SendPacket (p, txVector, input.preamble);
 }
 
 /*Method for allowing interfering nodes transmit
  * */
 void
-InterferenceMeasurement::InterfererSend (void) const
+InterferenceMeasurement::InterfererSend (uint32_t trial, uint32_t interferer) const
 {
-  Ptr<Packet> p = Create<Packet> (m_input.packetSizeB);
+  const struct Input &input = m_trials[trial];
+  const struct Interferer &intf = input.interferers[interferer];
+  Ptr<Packet> p = Create<Packet> (intf.packetSize);
   WifiTxVector txVector;
-  txVector.SetTxPowerLevel (m_input.txPowerLevelB);
-  txVector.SetMode (WifiMode (m_input.txModeB));
-  m_txB->SendPacket (p, txVector, m_input.preamble);
+  txVector.SetTxPowerLevel (intf.txPowerLevel);
+  txVector.SetMode (WifiMode (intf.txMode));
+  m_txB[interferer]->SendPacket (p, txVector, input.preamble);
+}
+
+/*Place the nodes of a trial and schedule its frames
+ * */
+void
+InterferenceMeasurement::StartTrial (uint32_t trial)
+{
+  const struct Input &input = m_trials[trial];
+  m_currentTrial = trial;
+  /*Nominal SINR at the receiver: the range propagation model leaves the
+   * transmit power unchanged, so only antenna gains and noise enter
+   * */
+  double gain = m_txA->GetTxGain () + m_rx->GetRxGain ();
+  double signalW = std::pow (10.0, (PowerDbm (input, input.txPowerLevelA) + gain - 30) / 10.0);
+  static const double BOLTZMANN = 1.3803e-23; //Boltzmann Constant
+  double noiseW = std::pow (10.0, m_rx->GetRxNoiseFigure () / 10.0) * BOLTZMANN * 290.0 * m_rx->GetChannelWidth () * 1e6;
+  double interferenceW = 0;
+  for (uint32_t b = 0; b < input.interferers.size (); b++)
+    {
+      interferenceW += std::pow (10.0, (PowerDbm (input, input.interferers[b].txPowerLevel) + gain - 30) / 10.0);
+    }
+  m_outcome[trial].sinr = 10 * std::log10 (signalW / (noiseW + interferenceW));
+  m_posA->SetPosition (Vector (input.pos_DesiredSignal, 0.0, 0.0));
+  Simulator::ScheduleNow (&InterferenceMeasurement::DesiredSend, this, trial);
+  for (uint32_t b = 0; b < input.interferers.size (); b++)
+    {
+      m_posB[b]->SetPosition (Vector (input.interferers[b].position, 0.0, 0.0));
+      Simulator::Schedule (input.interferers[b].offset, &InterferenceMeasurement::InterfererSend, this, trial, b);
+    }
+}
+
+/*Frames of the desired transmitter are told apart from interfering
+ * frames the receiver happened to lock on by their packet uid
+ * */
+void
+InterferenceMeasurement::RxOk (Ptr<Packet> p, double snr, WifiTxVector /*txVector*/, enum WifiPreamble /*preamble*/)
+{
+  if (p->GetUid () == m_desiredUid)
+    {
+      m_outcome[m_currentTrial].received = true;
+      m_outcome[m_currentTrial].success = true;
+    }
+  Record (p, snr, RX_OK);
+}
+
+void
+InterferenceMeasurement::RxError (Ptr<Packet> p, double snr)
+{
+  if (p->GetUid () == m_desiredUid)
+    {
+      m_outcome[m_currentTrial].received = true;
+    }
+  Record (p, snr, RX_ERROR);
+}
+
+/*Frames the PHY did not synchronise on, e.g. because it was already receiving
+ * */
+void
+InterferenceMeasurement::RxDrop (Ptr<const Packet> p)
+{
+  Record (p, 0, RX_DROP);
+}
+
+void
+InterferenceMeasurement::Record (Ptr<const Packet> p, double snr, enum RxEvent event)
+{
+  if (!m_rxTrace)
+    {
+      return;
+    }
+  //Value-initialised so the padding after the fields is written as zeros
+  struct RxRecord record = RxRecord ();
+  record.timeNs = Simulator::Now ().GetNanoSeconds ();
+  record.trial = m_currentTrial;
+  record.packetSize = p->GetSize ();
+  record.sinr = event == RX_DROP ? NAN : 10 * std::log10 (snr);
+  record.nominalSinr = m_outcome[m_currentTrial].sinr;
+  record.event = event;
+  record.desired = p->GetUid () == m_desiredUid;
+  m_rxRecords.Append (record);
+}
+
+bool
+InterferenceMeasurement::EnableRxTrace (std::string fileName, uint32_t capacity)
+{
+  m_rxTrace = m_rxRecords.Open (fileName, capacity);
+  return m_rxTrace;
+}
+
+uint64_t
+InterferenceMeasurement::GetRxTraceWritten (void) const
+{
+  return m_rxRecords.GetWritten ();
+}
+
+uint64_t
+InterferenceMeasurement::GetRxTraceLost (void) const
+{
+  return m_rxRecords.GetLost ();
+}
+
+double
+InterferenceMeasurement::PowerDbm (const struct Input &input, uint32_t level) const
+{
+  if (input.nTxPower <= 1)
+    {
+      return input.txPowerStart;
+    }
+  return input.txPowerStart + level * (input.txPowerEnd - input.txPowerStart) / (input.nTxPower - 1);
+}
+
+const std::vector<struct InterferenceMeasurement::Outcome> &
+InterferenceMeasurement::GetOutcomes (void) const
+{
+  return m_outcome;
 }
 
 InterferenceMeasurement::InterferenceMeasurement ()
+  : m_currentTrial (0),
+    m_desiredUid (0),
+    m_rxTrace (false)
+{
+}
+InterferenceMeasurement::Interferer::Interferer ()
+  : position (40),
+    txMode ("OfdmRate54Mbps"),
+    txPowerLevel (0),
+    packetSize (1500),
+    offset (MicroSeconds (0))
 {
 }
 InterferenceMeasurement::Input::Input ()
@@ -147,29 +473,58 @@ InterferenceMeasurement::Input::Input ()
 	//Predefined the 802.11n Standard
     standard (WIFI_PHY_STANDARD_80211n_2_4GHZ),
 	//Length of Preambale
-    preamble (WIFI_PREAMBLE_LONG)
+    preamble (WIFI_PREAMBLE_LONG),
+	//YansWifiPhy default power range
+    txPowerStart (16.0206),
+    txPowerEnd (16.0206),
+    nTxPower (1)
 {
 }
 
 void
 InterferenceMeasurement::Run (struct InterferenceMeasurement::Input input)
 {
-  m_input = input;
+  std::vector<struct Input> trials (1, input);
+  Run (trials, Seconds (0));
+}
 
-  //Number of active transmissions from STAs
-  int numActive = activeSTAs(1, 300);
-  std::vector<int>indexactivSTA(numActive);
-  //Index of Active Users
-  for(int k = 0; k < numActive; k++){
-	  indexactivSTA[k] = actvSTAind();
-  }
-  /* Distance between receiver AP and interfering node
+void
+InterferenceMeasurement::Run (const std::vector<struct InterferenceMeasurement::Input> &trials, Time spacing)
+{
+  m_trials = trials;
+  struct Outcome none = {false, false, 0};
+  m_outcome.assign (m_trials.size (), none);
+  /* Legacy single interferer description
    * */
-
+  for (uint32_t t = 0; t < m_trials.size (); t++)
+    {
+      struct Input &input = m_trials[t];
+      if (input.interferers.empty ())
+        {
+          Interferer intf;
+          intf.position = input.pos_InterfSignal;
+          intf.txMode = input.txModeB;
+          intf.txPowerLevel = input.txPowerLevelB;
+          intf.packetSize = input.packetSizeB;
+          intf.offset = input.interval;
+          input.interferers.push_back (intf);
+        }
+    }
 
 /* Compute interference range
+ * over all the nodes of all trials
  * */
-  double Interfrrange = std::max (std::abs (input.pos_DesiredSignal), input.pos_InterfSignal);
+  double Interfrrange = 0;
+  uint32_t poolSize = 0;
+  for (uint32_t t = 0; t < m_trials.size (); t++)
+    {
+      Interfrrange = std::max (Interfrrange, std::abs (m_trials[t].pos_DesiredSignal));
+      for (uint32_t b = 0; b < m_trials[t].interferers.size (); b++)
+        {
+          Interfrrange = std::max (Interfrrange, std::abs (m_trials[t].interferers[b].position));
+        }
+      poolSize = std::max (poolSize, (uint32_t) m_trials[t].interferers.size ());
+    }
   /*Use range propagation model to calculate power between
    * Desired node and interfering node
    * */
@@ -183,54 +538,199 @@ InterferenceMeasurement::Run (struct InterferenceMeasurement::Input input)
   Ptr<RangePropagationLossModel> pathloss_range = CreateObject<RangePropagationLossModel> ();
   //Install propagation loss model on channel
   channel->SetPropagationLossModel (pathloss_range);
-  //Mobility Model
-  Ptr<MobilityModel> pos_desiredNode = CreateObject<ConstantPositionMobilityModel> ();
-  /* Set position of desired signal
-   * */
-  pos_desiredNode->SetPosition (Vector (input.pos_DesiredSignal, 0.0, 0.0));
-  /* Set position of interfering node
-   * */
-  Ptr<MobilityModel> pos_interfrNode = CreateObject<ConstantPositionMobilityModel> ();
-  pos_interfrNode->SetPosition (Vector (input.pos_InterfSignal, 0.0, 0.0));
+  //Mobility Model of the desired node, placed by StartTrial
+  m_posA = CreateObject<ConstantPositionMobilityModel> ();
   //Position of receiver AP
   Ptr<MobilityModel> pos_rxAP = CreateObject<ConstantPositionMobilityModel> ();
   pos_rxAP->SetPosition (Vector (0.0, 0.0, 0.0));
 
-  m_txA = CreateObject<YansWifiPhy> ();
-  m_txB = CreateObject<YansWifiPhy> ();
-  Ptr<YansWifiPhy> rx = CreateObject<YansWifiPhy> ();
   // Error rate model
   Ptr<ErrorRateModel> error = CreateObject<YansErrorRateModel> ();
+  m_txA = CreateObject<YansWifiPhy> ();
+  m_rx = CreateObject<YansWifiPhy> ();
   m_txA->SetErrorRateModel (error);
-  m_txB->SetErrorRateModel (error);
-  rx->SetErrorRateModel (error);
+  m_rx->SetErrorRateModel (error);
   //Channel
   m_txA->SetChannel (channel);
-  m_txB->SetChannel (channel);
-  rx->SetChannel (channel);
-  m_txA->SetMobility (pos_desiredNode);
-  m_txB->SetMobility (pos_interfrNode);
-  rx->SetMobility (pos_rxAP);
-
+  m_rx->SetChannel (channel);
+  m_txA->SetMobility (m_posA);
+  m_rx->SetMobility (pos_rxAP);
+  //Transmit power levels
+  m_txA->SetTxPowerStart (m_trials[0].txPowerStart);
+  m_txA->SetTxPowerEnd (m_trials[0].txPowerEnd);
+  m_txA->SetNTxPower (m_trials[0].nTxPower);
   /* Install WiFi standard on the transmitter
    * and the receiver
    * */
-  m_txA->ConfigureStandard (input.standard);
-  m_txB->ConfigureStandard (input.standard);
+  m_txA->ConfigureStandard (m_trials[0].standard);
   /*Install Wifi Standard on the receiver
    * */
-  rx->ConfigureStandard (input.standard);
+  m_rx->ConfigureStandard (m_trials[0].standard);
+  //Outcome of every desired frame
+  m_rx->SetReceiveOkCallback (MakeCallback (&InterferenceMeasurement::RxOk, this));
+  m_rx->SetReceiveErrorCallback (MakeCallback (&InterferenceMeasurement::RxError, this));
+  m_rx->TraceConnectWithoutContext ("PhyRxDrop", MakeCallback (&InterferenceMeasurement::RxDrop, this));
+
+  /* Interfering transmitters, one per interferer of the largest trial
+   * */
+  m_txB.clear ();
+  m_posB.clear ();
+  for (uint32_t b = 0; b < poolSize; b++)
+    {
+      Ptr<MobilityModel> pos_interfrNode = CreateObject<ConstantPositionMobilityModel> ();
+      Ptr<YansWifiPhy> txB = CreateObject<YansWifiPhy> ();
+      txB->SetErrorRateModel (error);
+      txB->SetChannel (channel);
+      txB->SetMobility (pos_interfrNode);
+      txB->SetTxPowerStart (m_trials[0].txPowerStart);
+      txB->SetTxPowerEnd (m_trials[0].txPowerEnd);
+      txB->SetNTxPower (m_trials[0].nTxPower);
+      txB->ConfigureStandard (m_trials[0].standard);
+      m_txB.push_back (txB);
+      m_posB.push_back (pos_interfrNode);
+    }
 
   /*Schedule Transmission or Simulation
    * */
-  Simulator::Schedule (Seconds (0), &InterferenceMeasurement::DesiredSend, this);
-  Simulator::Schedule (Seconds (0) + input.interval, &InterferenceMeasurement::InterfererSend, this);
+  for (uint32_t t = 0; t < m_trials.size (); t++)
+    {
+      Simulator::Schedule (Seconds (spacing.GetSeconds () * t), &InterferenceMeasurement::StartTrial, this, t);
+    }
   /*Run Simulator
    * */
   Simulator::Run ();
   Simulator::Destroy ();
+  m_rxRecords.Flush ();
+}
+
+/* Build trials from a population of STAs placed at random around the receiver AP
+ * For every trial a random number of STAs is active (activeSTAs) and each active
+ * STA (actvSTAind) transmits with a random start offset
+ * */
+std::vector<InterferenceMeasurement::Input>
+BuildRandomTrials (const InterferenceMeasurement::Input &base, uint32_t numTrials,
+                   uint32_t maxInterferers, double areaRange, Time maxOffset)
+{
+  //Population of 300 STAs, matching the range drawn by actvSTAind
+  Ptr<UniformRandomVariable> pos = CreateObject<UniformRandomVariable> ();
+  std::vector<double> staPosition (300);
+  for (uint32_t s = 0; s < staPosition.size (); s++)
+    {
+      staPosition[s] = pos->GetValue (-areaRange, areaRange);
+    }
+  Ptr<UniformRandomVariable> offset = CreateObject<UniformRandomVariable> ();
+  std::vector<InterferenceMeasurement::Input> trials (numTrials, base);
+  for (uint32_t t = 0; t < numTrials; t++)
+    {
+      //Number of active transmissions from STAs
+      int numActive = activeSTAs (1, maxInterferers);
+      for (int k = 0; k < numActive; k++)
+        {
+          InterferenceMeasurement::Interferer intf;
+          //Index of Active Users
+          intf.position = staPosition[actvSTAind ()];
+          intf.txMode = base.txModeB;
+          intf.txPowerLevel = base.txPowerLevelB;
+          intf.packetSize = payLoadSizeGenerator (500, 1500);
+          intf.offset = MicroSeconds (offset->GetValue (0, maxOffset.GetMicroSeconds ()));
+          trials[t].interferers.push_back (intf);
+        }
+    }
+  return trials;
+}
+
+
+/* Measure the packet error rate of HT MCS 0 to maxMcs for every packet size
+ * over a SINR grid and store it as a PerTable.
+ * The SINR is set by the transmit power of a single interferer that overlaps the
+ * whole desired frame; all points run as batched trials of one simulator lifetime
+ * */
+bool
+GeneratePerTable (InterferenceMeasurement &experiment, std::string fileName, uint32_t maxMcs,
+                  const std::vector<uint32_t> &sizes, double sinrMin, double sinrMax, double sinrStep,
+                  uint32_t trialsPerPoint, Time spacing)
+{
+  //Power of the desired transmitter in dBm
+  double desiredDbm = 16.0;
+  uint32_t nSinr = (uint32_t) std::floor ((sinrMax - sinrMin) / sinrStep + 0.5) + 1;
+  InterferenceMeasurement::Input base;
+  base.standard = WIFI_PHY_STANDARD_80211n_2_4GHZ;
+  base.preamble = WIFI_PREAMBLE_HT_MF;
+  /*Interferer power grid covering the SINR grid, the desired power is put on the grid too
+   * */
+  base.txPowerStart = std::min (desiredDbm - sinrMax, desiredDbm);
+  base.txPowerEnd = std::max (desiredDbm - sinrMin, desiredDbm);
+  base.nTxPower = (uint32_t) std::floor ((base.txPowerEnd - base.txPowerStart) / sinrStep + 0.5) + 1;
+  base.txPowerLevelA = (uint32_t) std::floor ((desiredDbm - base.txPowerStart) / sinrStep + 0.5);
+  //Desired frame arrives first so that the receiver locks on it
+  base.pos_DesiredSignal = -1;
+
+  std::vector<std::string> modes;
+  std::vector<InterferenceMeasurement::Input> trials;
+  for (uint32_t mcs = 0; mcs <= maxMcs; mcs++)
+    {
+      std::ostringstream oss;
+      oss << "HtMcs" << mcs;
+      modes.push_back (oss.str ());
+      for (uint32_t s = 0; s < sizes.size (); s++)
+        {
+          for (uint32_t level = 0; level < base.nTxPower; level++)
+            {
+              InterferenceMeasurement::Input input = base;
+              input.txModeA = oss.str ();
+              input.packetSizeA = sizes[s];
+              InterferenceMeasurement::Interferer intf;
+              intf.position = 2;
+              intf.txMode = oss.str ();
+              intf.txPowerLevel = level;
+              intf.packetSize = sizes[s];
+              input.interferers.push_back (intf);
+              trials.insert (trials.end (), trialsPerPoint, input);
+            }
+        }
+    }
+  experiment.Run (trials, spacing);
+  const std::vector<InterferenceMeasurement::Outcome> &outcome = experiment.GetOutcomes ();
+
+  std::vector<uint32_t> sortedSizes (sizes);
+  std::sort (sortedSizes.begin (), sortedSizes.end ());
+  PerTable table (modes, sortedSizes, sinrMin, sinrStep, nSinr);
+  uint32_t t = 0;
+  for (uint32_t m = 0; m < modes.size (); m++)
+    {
+      for (uint32_t s = 0; s < sizes.size (); s++)
+        {
+          std::vector<std::pair<double, double> > points;
+          for (uint32_t level = 0; level < base.nTxPower; level++)
+            {
+              uint32_t errors = 0;
+              double sinr = outcome[t].sinr;
+              for (uint32_t n = 0; n < trialsPerPoint; n++, t++)
+                {
+                  errors += outcome[t].success ? 0 : 1;
+                }
+              points.push_back (std::make_pair (sinr, double (errors) / trialsPerPoint));
+            }
+          uint32_t sizeIndex = std::lower_bound (sortedSizes.begin (), sortedSizes.end (), sizes[s]) - sortedSizes.begin ();
+          table.SetCurve (m, sizeIndex, points);
+        }
+    }
+  return table.Save (fileName);
+}
 
-  //uint32_t sINR =
+/* Parse a comma separated list of packet sizes
+ * */
+std::vector<uint32_t>
+ParseSizes (std::string list)
+{
+  std::vector<uint32_t> sizes;
+  std::istringstream iss (list);
+  std::string item;
+  while (std::getline (iss, item, ','))
+    {
+      sizes.push_back (atoi (item.c_str ()));
+    }
+  return sizes;
 }
 
 
@@ -248,10 +748,71 @@ int main (int argc, char *argv[])
    * Desired signal and the interfering signal
    * */
   double delay = 0;
+  /*Batched experiments: number of trials, largest number of
+   * simultaneous interferers and time between trial starts
+   * */
+  uint32_t numTrials = 1;
+  uint32_t maxInterferers = 1;
+  double trialSpacing = 10; //milliseconds
+  double areaRange = 50; //meters around the receiver AP
+  /*PER lookup table generation
+   * */
+  std::string perTable = "";
+  uint32_t perMaxMcs = 7;
+  std::string perSizes = "500,1000,1500";
+  double sinrMin = -5;
+  double sinrMax = 35;
+  double sinrStep = 0.5;
+  uint32_t perTrials = 100;
+  /*Receive trace capture
+   * */
+  std::string rxTrace = "";
+  uint32_t rxTraceCapacity = 1 << 20;
+  bool verbose = false;
 
-  /*Output traces of InterferenceHelper log
+  CommandLine cmd;
+  cmd.AddValue ("delay", "Delay in microseconds between desired and interfering frame", delay);
+  cmd.AddValue ("numTrials", "Number of interference trials run in one simulator lifetime", numTrials);
+  cmd.AddValue ("maxInterferers", "Largest number of interferers in a random trial", maxInterferers);
+  cmd.AddValue ("trialSpacing", "Time between the start of two trials in milliseconds", trialSpacing);
+  cmd.AddValue ("areaRange", "Interferers are placed within +/- areaRange meters of the receiver", areaRange);
+  cmd.AddValue ("perTable", "Write a SINR to PER lookup table to this file and exit", perTable);
+  cmd.AddValue ("perMaxMcs", "Highest HT MCS of the PER table", perMaxMcs);
+  cmd.AddValue ("perSizes", "Comma separated packet sizes of the PER table", perSizes);
+  cmd.AddValue ("sinrMin", "Lowest SINR of the PER table in dB", sinrMin);
+  cmd.AddValue ("sinrMax", "Highest SINR of the PER table in dB", sinrMax);
+  cmd.AddValue ("sinrStep", "SINR step of the PER table in dB", sinrStep);
+  cmd.AddValue ("perTrials", "Frames sent per point of the PER table", perTrials);
+  cmd.AddValue ("rxTrace", "Binary file receiving one record per frame seen by the receiver AP", rxTrace);
+  cmd.AddValue ("rxTraceCapacity", "Records buffered in memory between two writes of the receive trace", rxTraceCapacity);
+  cmd.AddValue ("verbose", "Enable the InterferenceHelper log (slow)", verbose);
+  cmd.Parse (argc, argv);
+
+  /*Output traces of InterferenceHelper log, only for debugging:
+   * SINR and PER are captured by the receive trace instead
      */
-  LogComponentEnable ("InterferenceHelper", LOG_LEVEL_ALL);
+  if (verbose)
+    {
+      LogComponentEnable ("InterferenceHelper", LOG_LEVEL_ALL);
+    }
+  //Call the interference Class
+  InterferenceMeasurement experiment;
+  if (!rxTrace.empty () && !experiment.EnableRxTrace (rxTrace, rxTraceCapacity))
+    {
+      std::cout << "Unable to open the receive trace " << rxTrace << std::endl;
+      return 1;
+    }
+
+  if (!perTable.empty ())
+    {
+      if (!GeneratePerTable (experiment, perTable, perMaxMcs, ParseSizes (perSizes), sinrMin, sinrMax,
+                             sinrStep, perTrials, MilliSeconds (trialSpacing)))
+        {
+          std::cout << "Unable to store the PER table in " << perTable << std::endl;
+          return 1;
+        }
+      return 0;
+    }
 
   /*With the helper of delay
    * Time interval is defined for start of each frame
@@ -261,9 +822,21 @@ int main (int argc, char *argv[])
   /* Set the WiFi Standard
    * */
   input.standard = WIFI_PHY_STANDARD_80211n_2_4GHZ;
-  //Call the interference Class
-  InterferenceMeasurement experiment;
-  experiment.Run (input);
+  if (numTrials <= 1)
+    {
+      experiment.Run (input);
+    }
+  else
+    {
+      std::vector<InterferenceMeasurement::Input> trials =
+        BuildRandomTrials (input, numTrials, maxInterferers, areaRange, MicroSeconds (delay));
+      experiment.Run (trials, MilliSeconds (trialSpacing));
+    }
+  if (!rxTrace.empty ())
+    {
+      std::cout << experiment.GetRxTraceWritten () << " receive records written to " << rxTrace
+                << ", " << experiment.GetRxTraceLost () << " lost" << std::endl;
+    }
 
   return 0;
 }
@@ -239,7 +239,7 @@ int main (int argc, char *argv[])
 		for (int kc = 0; kc < numAPs; kc++) {
 			if (RSS_ULdBm[ck][kc] > tempRss_max) {
 				tempRss_max = RSS_ULdBm[ck][kc];
-				Xij_DL[ck][tempind] = 0;
+				Xij_UL[ck][tempind] = 0;
 				tempind = kc;
 			} else {
 				Xij_UL[ck][kc] = 0;